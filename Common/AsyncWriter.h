@@ -0,0 +1,152 @@
+//Background file writer shared by the simulators
+//the simulation hands over a buffer (or a function that makes it, e.g. encoding a
+//copy of the state) and goes on, while a single writer thread does the encoding and
+//the disk I/O, in the order the jobs were submitted. at most maxPending jobs are
+//queued: a simulation that produces data faster than the disk takes it waits for a
+//free place instead of filling the memory
+
+#ifndef ASYNCWRITER_H
+#define ASYNCWRITER_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdio>
+
+class AsyncWriter {
+
+    public:
+        AsyncWriter(int maxPending_ = 2) {
+            maxPending = (maxPending_ > 0) ? maxPending_ : 1;
+            writer = std::thread(&AsyncWriter::work, this);
+        }
+
+        //queues the file made by produce(). whole files are written to "<filename>.tmp"
+        //and renamed when complete, so that readers never see half a file. with
+        //append, the bytes are added at the end of the file instead (which is kept open
+        //between consecutive appends to it)
+        void write(std::string filename, std::function<std::string()> produce, bool append = false) {
+            std::unique_lock<std::mutex> lock(m);
+            spaceAvailable.wait(lock, [this] { return (int)jobs.size() < maxPending; });
+            jobs.push(Job{filename, produce, append});
+            pending++;
+            jobAvailable.notify_one();
+        }
+
+        //queues bytes that are already made
+        void write(std::string filename, std::string data, bool append = false) {
+            write(filename, [data] { return data; }, append);
+        }
+
+        //blocks until every queued job is written, and flushes the open file
+        void wait() {
+            std::unique_lock<std::mutex> lock(m);
+            allDone.wait(lock, [this] { return pending == 0; });
+        }
+
+        //false if any write has failed (an error is printed when it happens)
+        bool ok() {
+            std::unique_lock<std::mutex> lock(m);
+            return !failed;
+        }
+
+        ~AsyncWriter() {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                stopping = true;
+            }
+            jobAvailable.notify_all();
+            writer.join();
+        }
+
+    private:
+        struct Job {
+            std::string filename;
+            std::function<std::string()> produce;
+            bool append;
+        };
+
+        std::thread writer;
+        std::queue<Job> jobs;
+        std::mutex m;
+        std::condition_variable jobAvailable;
+        std::condition_variable spaceAvailable;
+        std::condition_variable allDone;
+        int maxPending;
+        int pending = 0;
+        bool stopping = false;
+        bool failed = false;
+        //file being appended to, only used by the writer thread
+        std::ofstream appendFile;
+        std::string appendFilename;
+
+        void work() {
+            while (true) {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+                    if (jobs.empty()) {
+                        if (appendFile.is_open()) appendFile.close();
+                        return;
+                    }
+                    job = jobs.front();
+                    jobs.pop();
+                }
+                spaceAvailable.notify_one();
+                bool good = job.append ? appendTo(job.filename, job.produce()) : writeWhole(job.filename, job.produce());
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    if (!good) failed = true;
+                    pending--;
+                    if (pending == 0) {
+                        if (appendFile.is_open()) appendFile.flush();
+                        allDone.notify_all();
+                    }
+                }
+            }
+        }
+
+        bool writeWhole(const std::string &filename, const std::string &data) {
+            if (appendFile.is_open() && appendFilename == filename) appendFile.close();
+            std::string tmpFilename = filename + ".tmp";
+            std::ofstream file(tmpFilename, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!file.is_open()) {
+                std::cout << "\nCouldn't open file: " << tmpFilename << "\n";
+                return false;
+            }
+            file.write(data.data(), data.size());
+            file.close();
+            if (!file || std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+                std::cout << "\nCouldn't write file: " << filename << "\n";
+                return false;
+            }
+            return true;
+        }
+
+        bool appendTo(const std::string &filename, const std::string &data) {
+            if (!appendFile.is_open() || appendFilename != filename) {
+                if (appendFile.is_open()) appendFile.close();
+                appendFile.open(filename, std::ios::out | std::ios::app | std::ios::binary);
+                appendFilename = filename;
+                if (!appendFile.is_open()) {
+                    std::cout << "\nCouldn't open file: " << filename << "\n";
+                    return false;
+                }
+            }
+            appendFile.write(data.data(), data.size());
+            if (!appendFile) {
+                std::cout << "\nCouldn't write file: " << filename << "\n";
+                appendFile.close();
+                return false;
+            }
+            return true;
+        }
+};
+
+#endif
@@ -0,0 +1,192 @@
+//Lightweight instrumentation shared by the simulators
+//the main loop of a simulation is split in phases (moving walkers, sticking them,
+//forces, integration, I/O...), each with a time, a number of calls and a count of the
+//items it processed (walker moves, pairs, sweeps...). scoped timers fill them in, a
+//progress line with the rate and the time left is printed a few times per second at
+//most, and the whole profile can be written as JSON when the run ends, so that runs
+//can be compared by scripts. timers given a NULL Profiler do nothing, so instrumented
+//code only pays for a test when profiling is off
+//a Profiler is not thread safe: time parallel sections from the thread that starts them
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+
+class Profiler {
+
+    public:
+        //steps of the main loop done so far, for the rates of the summary and profile
+        long long steps = 0;
+        //if not empty, the profile is written to this file by the destructor
+        std::string dumpFilename;
+
+        //progress is printed at most once every interval seconds (never if interval <= 0)
+        Profiler(std::string name_ = "run", double interval_ = 0.5) {
+            name = name_;
+            interval = interval_;
+            start = std::chrono::steady_clock::now();
+            lastReport = start;
+        }
+
+        //index of the phase with this name, created on first use. look it up once,
+        //outside the loop, and give the index to the timers
+        int phase(const std::string &phaseName) {
+            for (int i = 0; i < (int)phases.size(); i++) {
+                if (phases[i].name == phaseName) return i;
+            }
+            Phase p;
+            p.name = phaseName;
+            phases.push_back(p);
+            return phases.size() - 1;
+        }
+
+        //one call of phase p, that took seconds and processed items
+        void add(int p, double seconds, long long items = 0) {
+            phases[p].calls++;
+            phases[p].seconds += seconds;
+            phases[p].items += items;
+        }
+
+        //items processed by phase p, without timing it
+        void count(int p, long long items) {
+            phases[p].items += items;
+        }
+
+        //times the scope it is declared in as one call of a phase
+        class Timer {
+            public:
+                Timer(Profiler *profiler_, int p_, long long items_ = 0) {
+                    profiler = profiler_;
+                    p = p_;
+                    items = items_;
+                    if (profiler) begin = std::chrono::steady_clock::now();
+                }
+
+                //items processed, when they are only known at the end
+                void addItems(long long n) {
+                    items += n;
+                }
+
+                ~Timer() {
+                    if (profiler) {
+                        std::chrono::duration<double> d = std::chrono::steady_clock::now() - begin;
+                        profiler->add(p, d.count(), items);
+                    }
+                }
+
+            private:
+                Profiler *profiler;
+                int p;
+                long long items;
+                std::chrono::steady_clock::time_point begin;
+        };
+
+        //seconds since the profiler was created
+        double elapsed() {
+            std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+            return d.count();
+        }
+
+        //true at most once every interval seconds, when the progress line should be
+        //printed. checking costs one clock read, so it can be done on every step
+        bool due() {
+            if (interval <= 0) return false;
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            std::chrono::duration<double> d = now - lastReport;
+            if (d.count() < interval) return false;
+            lastReport = now;
+            return true;
+        }
+
+        //prints "<label> | <rate> steps/s | ETA <t> s" over the current line. the rate is
+        //the one since the last report, and the ETA assumes the rest of the run (1 -
+        //fraction of it) goes as fast as the part done. fraction <= 0 leaves out the ETA
+        void progress(long long steps_, double fraction, const std::string &label) {
+            steps = steps_;
+            double now = elapsed();
+            double rate = (now > lastTime) ? (steps - lastSteps)/(now - lastTime) : 0;
+            lastSteps = steps;
+            lastTime = now;
+            char line[128];
+            int n = snprintf(line, sizeof(line), " | %.4g steps/s", rate);
+            if (fraction > 0 && fraction < 1) {
+                snprintf(line + n, sizeof(line) - n, " | ETA %.3g s", now*(1 - fraction)/fraction);
+            }
+            std::cout << "\r" << label << line << "     " << std::flush;
+        }
+
+        //prints a table of the phases: calls, time, share of the run, items and their rate
+        void summary() {
+            double wall = elapsed();
+            char line[160];
+            snprintf(line, sizeof(line), "\nProfile of %s: %.3f s, %lld steps (%.4g steps/s)\n",
+                     name.c_str(), wall, steps, (wall > 0) ? steps/wall : 0.0);
+            std::cout << line;
+            for (size_t i = 0; i < phases.size(); i++) {
+                const Phase &p = phases[i];
+                snprintf(line, sizeof(line), " %-12s %10lld calls %10.3f s %6.1f %%", p.name.c_str(),
+                         p.calls, p.seconds, (wall > 0) ? 100*p.seconds/wall : 0.0);
+                std::cout << line;
+                if (p.items > 0) {
+                    snprintf(line, sizeof(line), " %12lld items", p.items);
+                    std::cout << line;
+                }
+                if (p.items > 0 && p.seconds > 0) {
+                    snprintf(line, sizeof(line), " (%.4g/s)", p.items/p.seconds);
+                    std::cout << line;
+                }
+                std::cout << "\n";
+            }
+        }
+
+        //writes the profile to filename as JSON:
+        //{"name": ..., "seconds": ..., "steps": ..., "phases": [{"name": ..., "calls": ...,
+        // "seconds": ..., "items": ...}, ...]}
+        bool dump(const std::string &filename) {
+            std::ofstream file(filename, std::ios::out | std::ios::trunc);
+            if (!file.is_open()) {
+                std::cout << "Couldn't open file: " << filename << "\n";
+                return false;
+            }
+            char number[32];
+            snprintf(number, sizeof(number), "%.9g", elapsed());
+            file << "{\"name\": \"" << name << "\", \"seconds\": " << number << ", \"steps\": " << steps
+                 << ", \"phases\": [";
+            for (size_t i = 0; i < phases.size(); i++) {
+                snprintf(number, sizeof(number), "%.9g", phases[i].seconds);
+                file << (i ? ", " : "") << "\n  {\"name\": \"" << phases[i].name << "\", \"calls\": "
+                     << phases[i].calls << ", \"seconds\": " << number << ", \"items\": "
+                     << phases[i].items << "}";
+            }
+            file << "\n]}\n";
+            return (bool)file;
+        }
+
+        ~Profiler() {
+            if (!dumpFilename.empty()) dump(dumpFilename);
+        }
+
+    private:
+        struct Phase {
+            std::string name;
+            long long calls = 0;
+            double seconds = 0;
+            long long items = 0;
+        };
+
+        std::string name;
+        double interval;
+        std::vector<Phase> phases;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point lastReport;
+        long long lastSteps = 0;
+        double lastTime = 0;
+};
+
+#endif
@@ -0,0 +1,197 @@
+//Fast random numbers for the Monte Carlo simulators
+//xoshiro256++ (Blackman & Vigna), run as 4 interleaved lanes. next() cycles
+//through the lanes, and the bulk fill functions advance the 4 lanes at once in a
+//loop the compiler turns into SIMD code, giving exactly the same numbers as the
+//equivalent sequence of next() calls. so a simulation gives the same results for a
+//given seed whether it draws numbers one at a time or in bulk
+//
+//independent streams (e.g. one per thread) are obtained by skipping ahead:
+//stream(k) starts 2^192 * k numbers further along the same sequence
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+#include <cstddef>
+
+class Random {
+
+    public:
+        static const int lanes = 4;
+
+        Random(uint64_t seed_ = 0) {
+            seed(seed_);
+        }
+
+        //fill the state from a single 64 bit seed, using splitmix64 as recommended
+        //lane k starts 2^128 * k numbers after lane 0, so lanes never overlap
+        void seed(uint64_t seed_) {
+            uint64_t z = seed_;
+            for (int w = 0; w < 4; w++) s[w][0] = splitmix64(z);
+            for (int l = 1; l < lanes; l++) {
+                for (int w = 0; w < 4; w++) s[w][l] = s[w][l-1];
+                jumpLane(l, jumpPoly());
+            }
+            lane = 0;
+        }
+
+        //returns 64 random bits
+        uint64_t next() {
+            int l = lane;
+            lane = (lane + 1) & (lanes - 1);
+            return stepLane(l);
+        }
+
+        //uniform double in [0, 1)
+        double uniform() {
+            return toUniform(next());
+        }
+
+        //uniform integer in [0, n), without bias (Lemire's method)
+        uint32_t below(uint32_t n) {
+            uint64_t m = (next() >> 32) * n;
+            uint32_t low = (uint32_t)m;
+            if (low < n) {
+                uint32_t t = (uint32_t)(-n) % n;
+                while (low < t) {
+                    m = (next() >> 32) * n;
+                    low = (uint32_t)m;
+                }
+            }
+            return m >> 32;
+        }
+
+        //bulk fill of n words of random bits
+        void fillBits(uint64_t *out, size_t n) {
+            size_t i = 0;
+            //finish the current round of lanes one number at a time
+            while (i < n && lane != 0) out[i++] = next();
+            //then whole rounds, all lanes at once. the state is copied to locals so
+            //the compiler knows it can't alias out, and keeps it in vector registers
+            uint64_t s0[lanes], s1[lanes], s2[lanes], s3[lanes];
+            for (int l = 0; l < lanes; l++) {
+                s0[l] = s[0][l]; s1[l] = s[1][l]; s2[l] = s[2][l]; s3[l] = s[3][l];
+            }
+            for (; i + lanes <= n; i += lanes) {
+                for (int l = 0; l < lanes; l++) {
+                    out[i+l] = rotl(s0[l] + s3[l], 23) + s0[l];
+                    uint64_t t = s1[l] << 17;
+                    s2[l] ^= s0[l];
+                    s3[l] ^= s1[l];
+                    s1[l] ^= s2[l];
+                    s0[l] ^= s3[l];
+                    s2[l] ^= t;
+                    s3[l] = rotl(s3[l], 45);
+                }
+            }
+            for (int l = 0; l < lanes; l++) {
+                s[0][l] = s0[l]; s[1][l] = s1[l]; s[2][l] = s2[l]; s[3][l] = s3[l];
+            }
+            while (i < n) out[i++] = next();
+        }
+
+        //bulk fill of n uniform doubles in [0, 1)
+        void fillUniform(double *out, size_t n) {
+            const size_t chunk = 256;
+            uint64_t bits[chunk];
+            for (size_t i = 0; i < n; i += chunk) {
+                size_t m = (n - i < chunk) ? n - i : chunk;
+                fillBits(bits, m);
+                for (size_t k = 0; k < m; k++) out[i+k] = toUniform(bits[k]);
+            }
+        }
+
+        //bulk fill of n uniform integers in [0, bound)
+        //the rejection step is skipped here so that every number costs exactly one
+        //word, which leaves a bias of at most bound/2^32 (negligible for lattice indices)
+        void fillBelow(uint32_t *out, size_t n, uint32_t bound) {
+            const size_t chunk = 256;
+            uint64_t bits[chunk];
+            for (size_t i = 0; i < n; i += chunk) {
+                size_t m = (n - i < chunk) ? n - i : chunk;
+                fillBits(bits, m);
+                for (size_t k = 0; k < m; k++) out[i+k] = ((bits[k] >> 32) * bound) >> 32;
+            }
+        }
+
+        //skip 2^128 numbers ahead on every lane
+        void jump() {
+            for (int l = 0; l < lanes; l++) jumpLane(l, jumpPoly());
+        }
+
+        //skip 2^192 numbers ahead on every lane
+        void longJump() {
+            for (int l = 0; l < lanes; l++) jumpLane(l, longJumpPoly());
+        }
+
+        //a copy of this generator moved k long jumps ahead. streams 0, 1, 2, ... of
+        //the same seed never overlap, so they can be given to different threads
+        Random stream(int k) {
+            Random r = *this;
+            for (int i = 0; i < k; i++) r.longJump();
+            return r;
+        }
+
+        //converts 64 random bits into a double in [0, 1), using the top 53 bits
+        static double toUniform(uint64_t r) {
+            return (r >> 11) * (1.0/9007199254740992.0); //2^-53
+        }
+
+        //splitmix64: a good 64 bit mixer, used for seeding and as a counter based hash
+        static uint64_t splitmix64(uint64_t &x) {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        //the full state, so that it can be saved and restored
+        //s[w][l] is word w of lane l
+        uint64_t s[4][lanes];
+        int lane;
+
+    private:
+        static const uint64_t *jumpPoly() {
+            static const uint64_t poly[4] = {
+                0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+            };
+            return poly;
+        }
+        static const uint64_t *longJumpPoly() {
+            static const uint64_t poly[4] = {
+                0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL
+            };
+            return poly;
+        }
+
+        static uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        uint64_t stepLane(int l) {
+            uint64_t r = rotl(s[0][l] + s[3][l], 23) + s[0][l];
+            uint64_t t = s[1][l] << 17;
+            s[2][l] ^= s[0][l];
+            s[3][l] ^= s[1][l];
+            s[1][l] ^= s[2][l];
+            s[0][l] ^= s[3][l];
+            s[2][l] ^= t;
+            s[3][l] = rotl(s[3][l], 45);
+            return r;
+        }
+
+        void jumpLane(int l, const uint64_t *poly) {
+            uint64_t j[4] = {0, 0, 0, 0};
+            for (int i = 0; i < 4; i++) {
+                for (int b = 0; b < 64; b++) {
+                    if (poly[i] & (1ULL << b)) {
+                        for (int w = 0; w < 4; w++) j[w] ^= s[w][l];
+                    }
+                    stepLane(l);
+                }
+            }
+            for (int w = 0; w < 4; w++) s[w][l] = j[w];
+        }
+};
+
+#endif
@@ -0,0 +1,85 @@
+//A small fixed-size thread pool shared by the simulators
+//jobs are run in the order they were submitted (FIFO), so callers that want
+//the most expensive work to start first should submit it first
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class ThreadPool {
+
+    public:
+        //nThreads = 0 uses one thread per hardware core
+        ThreadPool(int nThreads = 0) {
+            if (nThreads <= 0) nThreads = std::thread::hardware_concurrency();
+            if (nThreads <= 0) nThreads = 1;
+            for (int i = 0; i < nThreads; i++) {
+                workers.push_back(std::thread(&ThreadPool::work, this));
+            }
+        }
+
+        int size() {
+            return workers.size();
+        }
+
+        //queue a job to be run by any free worker
+        void submit(std::function<void()> job) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                jobs.push(job);
+                pending++;
+            }
+            jobAvailable.notify_one();
+        }
+
+        //block until every submitted job has finished
+        void wait() {
+            std::unique_lock<std::mutex> lock(m);
+            allDone.wait(lock, [this] { return pending == 0; });
+        }
+
+        ~ThreadPool() {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                stopping = true;
+            }
+            jobAvailable.notify_all();
+            for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> jobs;
+        std::mutex m;
+        std::condition_variable jobAvailable;
+        std::condition_variable allDone;
+        int pending = 0;
+        bool stopping = false;
+
+        void work() {
+            while (true) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+                    if (stopping && jobs.empty()) return;
+                    job = jobs.front();
+                    jobs.pop();
+                }
+                job();
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    pending--;
+                    if (pending == 0) allDone.notify_all();
+                }
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,258 @@
+//2D grids of bits, used by the DLA aggregate and its box counting pyramid
+//Bitmap stores every cell, TiledBitmap only the 64 x 64 tiles that hold a set bit
+//(and TiledArray does the same for a grid of other values)
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <algorithm>
+
+//ORs bits 2k and 2k+1 of x into bit k of the result, for k = 0 .. 31
+inline uint64_t orPairs(uint64_t x) {
+    x = (x | (x >> 1)) & 0x5555555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+    x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+    return x;
+}
+
+//a W x H grid of bits, each row padded to whole 64 bit words
+class Bitmap {
+    public:
+        int W = 0;
+        int H = 0;
+        int wordsPerRow = 0;
+        std::vector<uint64_t> words;
+
+        Bitmap() {}
+
+        Bitmap(int h, int w) {
+            H = h;
+            W = w;
+            wordsPerRow = (W + 63)/64;
+            words.assign((size_t)wordsPerRow*H, 0);
+        }
+
+        bool get(int y, int x) {
+            return (words[(size_t)y*wordsPerRow + x/64] >> (x%64)) & 1;
+        }
+
+        void set(int y, int x) {
+            words[(size_t)y*wordsPerRow + x/64] |= 1ULL << (x%64);
+        }
+
+        size_t bytes() {
+            return words.size()*sizeof(uint64_t);
+        }
+
+        //number of bits set
+        long long count() {
+            long long n = 0;
+            for (size_t i = 0; i < words.size(); i++) n += __builtin_popcountll(words[i]);
+            return n;
+        }
+
+        //the bitmap of 2 x 2 blocks: bit (y, x) of the result is the OR of bits
+        //(2y, 2x), (2y, 2x+1), (2y+1, 2x) and (2y+1, 2x+1). works a word at a time:
+        //the two rows are ORed, then each pair of neighbouring bits, and the 32 results
+        //of each word are packed into half a word
+        Bitmap halved() {
+            Bitmap h((H + 1)/2, (W + 1)/2);
+            for (int y = 0; y < h.H; y++) {
+                const uint64_t *a = &words[(size_t)(2*y)*wordsPerRow];
+                const uint64_t *b = (2*y+1 < H) ? &words[(size_t)(2*y+1)*wordsPerRow] : a;
+                uint64_t *out = &h.words[(size_t)y*h.wordsPerRow];
+                for (int j = 0; j < wordsPerRow; j++) {
+                    uint64_t half = orPairs(a[j] | b[j]);
+                    out[j/2] |= (j % 2) ? half << 32 : half;
+                }
+            }
+            return h;
+        }
+};
+
+//allocates memory in large chunks and hands out pieces of it, which are only freed
+//all at once, with the arena. much cheaper than one new per piece, and no per piece
+//overhead
+class Arena {
+    public:
+        //pieces of n words, zeroed
+        uint64_t *allocate(size_t n) {
+            if (used + n > chunkWords) {
+                chunks.push_back(std::vector<uint64_t>(chunkWords, 0));
+                used = 0;
+            }
+            uint64_t *p = &chunks.back()[used];
+            used += n;
+            return p;
+        }
+
+        size_t bytes() {
+            return chunks.size()*chunkWords*sizeof(uint64_t);
+        }
+
+    private:
+        //1 MB chunks
+        static const size_t chunkWords = 1 << 17;
+        std::vector<std::vector<uint64_t>> chunks;
+        size_t used = chunkWords;
+};
+
+//the same as Bitmap, for lattices much larger than the set of cells in use: the grid
+//is split in 64 x 64 tiles of 64 words (one per row), and a tile is only allocated
+//(from an arena) when one of its bits is set. reading a bit of a missing tile gives 0,
+//so walkers can read anywhere without allocating. the directory of tiles costs one
+//pointer per tile, 1/512 of a bit per cell of the dense Bitmap
+class TiledBitmap {
+    public:
+        int W = 0;
+        int H = 0;
+        int tilesW = 0;
+        int tilesH = 0;
+
+        TiledBitmap() {}
+
+        TiledBitmap(int h, int w) {
+            H = h;
+            W = w;
+            tilesW = (W + 63)/64;
+            tilesH = (H + 63)/64;
+            tiles.assign((size_t)tilesW*tilesH, NULL);
+            arena.reset(new Arena());
+        }
+
+        //copies get their own tiles
+        TiledBitmap(const TiledBitmap &other) {
+            H = other.H;
+            W = other.W;
+            tilesW = other.tilesW;
+            tilesH = other.tilesH;
+            tiles.assign(other.tiles.size(), NULL);
+            arena.reset(new Arena());
+            for (size_t i = 0; i < tiles.size(); i++) {
+                if (!other.tiles[i]) continue;
+                tiles[i] = arena->allocate(64);
+                std::copy(other.tiles[i], other.tiles[i] + 64, tiles[i]);
+            }
+        }
+
+        TiledBitmap &operator=(TiledBitmap other) {
+            std::swap(H, other.H);
+            std::swap(W, other.W);
+            std::swap(tilesW, other.tilesW);
+            std::swap(tilesH, other.tilesH);
+            tiles.swap(other.tiles);
+            arena.swap(other.arena);
+            return *this;
+        }
+
+        TiledBitmap(TiledBitmap &&other) = default;
+
+        bool get(int y, int x) {
+            const uint64_t *t = tiles[(size_t)(y >> 6)*tilesW + (x >> 6)];
+            return t && ((t[y & 63] >> (x & 63)) & 1);
+        }
+
+        void set(int y, int x) {
+            tile(y >> 6, x >> 6)[y & 63] |= 1ULL << (x & 63);
+        }
+
+        //memory in use: directory and allocated chunks
+        size_t bytes() {
+            return tiles.size()*sizeof(uint64_t*) + arena->bytes();
+        }
+
+        size_t tileCount() {
+            size_t n = 0;
+            for (size_t i = 0; i < tiles.size(); i++) n += (tiles[i] != NULL);
+            return n;
+        }
+
+        long long count() {
+            long long n = 0;
+            for (size_t i = 0; i < tiles.size(); i++) {
+                if (!tiles[i]) continue;
+                for (int r = 0; r < 64; r++) n += __builtin_popcountll(tiles[i][r]);
+            }
+            return n;
+        }
+
+        //see Bitmap::halved(). each tile becomes a 32 x 32 quarter of a tile
+        TiledBitmap halved() {
+            TiledBitmap h((H + 1)/2, (W + 1)/2);
+            for (int ty = 0; ty < tilesH; ty++) {
+                for (int tx = 0; tx < tilesW; tx++) {
+                    const uint64_t *t = tiles[(size_t)ty*tilesW + tx];
+                    if (!t) continue;
+                    uint64_t *out = h.tile(ty/2, tx/2) + 32*(ty % 2);
+                    for (int r = 0; r < 32; r++) out[r] |= orPairs(t[2*r] | t[2*r+1]) << (32*(tx % 2));
+                }
+            }
+            return h;
+        }
+
+    private:
+        std::vector<uint64_t*> tiles;
+        std::unique_ptr<Arena> arena;
+
+        uint64_t *tile(int ty, int tx) {
+            uint64_t *&t = tiles[(size_t)ty*tilesW + tx];
+            if (!t) t = arena->allocate(64);
+            return t;
+        }
+};
+
+//a W x H grid of values of type T, stored in 64 x 64 tiles like TiledBitmap: cells of
+//tiles that were never written read as the background value
+template <class T>
+class TiledArray {
+    public:
+        int W = 0;
+        int H = 0;
+
+        TiledArray() {}
+
+        TiledArray(int h, int w, T background_) {
+            H = h;
+            W = w;
+            background = background_;
+            tilesW = (W + 63)/64;
+            tiles.assign((size_t)((H + 63)/64)*tilesW, NULL);
+            arena.reset(new Arena());
+        }
+
+        T get(int y, int x) {
+            const T *t = tiles[(size_t)(y >> 6)*tilesW + (x >> 6)];
+            return t ? t[(y & 63)*64 + (x & 63)] : background;
+        }
+
+        //reference to cell (y, x), allocating its tile if needed
+        T &at(int y, int x) {
+            T *&t = tiles[(size_t)(y >> 6)*tilesW + (x >> 6)];
+            if (!t) {
+                t = (T*)arena->allocate((64*64*sizeof(T) + 7)/8);
+                std::fill(t, t + 64*64, background);
+            }
+            return t[(y & 63)*64 + (x & 63)];
+        }
+
+        size_t bytes() {
+            return tiles.size()*sizeof(T*) + arena->bytes();
+        }
+
+    private:
+        int tilesW = 0;
+        T background = T();
+        std::vector<T*> tiles;
+        std::unique_ptr<Arena> arena;
+};
+
+typedef TiledArray<uint8_t> TiledBytes;
+
+#endif
@@ -0,0 +1,705 @@
+//Diffusion limited aggregation: many particles on a periodic grid (Grid), or one walker
+//at a time around a growing cluster (Cluster)
+//shared by main.cpp (simulation) and bench.cpp (throughput benchmark)
+
+#ifndef DLA_H
+#define DLA_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+
+#include "../Common/Random.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/AsyncWriter.h"
+#include "../Common/Profiler.h"
+#include "Bitmap.h"
+#include "Fractal.h"
+#include "Output.h"
+
+//modulus function
+//different from simply remainder, denoted by "%"
+//we want, for example, mod(-1, 10) to be 9 and not -1
+//so that we can access indices of grid periodically
+inline int mod(int x, int N) {
+    return (x % N + N) % N;
+}
+
+//the walking particles, stored as a structure of arrays so that the update loop
+//runs over contiguous memory. removing a particle moves the last one into its place
+class Walkers {
+    public:
+        std::vector<int> y;
+        std::vector<int> x;
+        //step at which the particle moves next (only used by long jumps)
+        std::vector<int> wake;
+        //number given to the particle when it was created, which never changes
+        //(only used by the parallel engine, to key its random numbers)
+        std::vector<int> id;
+
+        int size() {
+            return y.size();
+        }
+
+        void add(int y_, int x_) {
+            y.push_back(y_);
+            x.push_back(x_);
+            wake.push_back(0);
+            id.push_back(id.size() + removed);
+        }
+
+        //swap-and-pop: O(1), but changes the order of the particles
+        void remove(int i) {
+            y[i] = y.back();
+            x[i] = x.back();
+            wake[i] = wake.back();
+            id[i] = id.back();
+            y.pop_back();
+            x.pop_back();
+            wake.pop_back();
+            id.pop_back();
+            removed++;
+        }
+
+        //removes every particle i with gone[i] != 0, keeping the order of the rest
+        void removeMarked(const std::vector<char> &gone) {
+            int n = 0;
+            for (int i = 0; i < size(); i++) {
+                if (gone[i]) continue;
+                y[n] = y[i];
+                x[n] = x[i];
+                wake[n] = wake[i];
+                id[n] = id[i];
+                n++;
+            }
+            removed += size() - n;
+            y.resize(n);
+            x.resize(n);
+            wake.resize(n);
+            id.resize(n);
+        }
+
+    private:
+        int removed = 0;
+};
+
+//a lattice aggregate, grown from a seed at the center: what both the many particle
+//Grid and the single walker Cluster stick their particles to. its bitmaps are of
+//type Lattice: Bitmap stores every cell, TiledBitmap only the tiles in use
+template <class Lattice>
+class Aggregate {
+
+    public:
+        int W;
+        int H;
+        //the aggregate is kept as two bitmaps: its cells, which are level 0 of the box
+        //counting pyramid (see Fractal.h), and sticky, which marks every cell that has an
+        //aggregate cell among its 8 neighbours (or is one), so that deciding whether a
+        //particle sticks is a single bit test. both are updated incrementally in stick().
+        //the attachment times, only needed for the output, are kept in the list of
+        //sites, in the order they were attached
+        BoxPyramid<Lattice> boxes;
+        Lattice sticky;
+        std::vector<Site> sites;
+        //largest distance from the seed to a cell of the aggregate
+        double R_max = 0;
+        //accelerated walks, see enableLongJumps()
+        bool longJumps = false;
+
+        Aggregate(int h, int w) {
+            //height and width of grid
+            W = w;
+            H = h;
+            boxes = BoxPyramid<Lattice>(H, W);
+            sticky = Lattice(H, W);
+            cy = H/2;
+            cx = W/2;
+            blocksH = (H + blockSize - 1)/blockSize;
+            blocksW = (W + blockSize - 1)/blockSize;
+            blockDistance = TiledBytes(blocksH, blocksW, maxBlockDistance);
+        }
+
+        //save the agreggate to file, in the format given by its extension (see Output.h):
+        //".bin", ".rle", ".pgm", ".ppm", or else text
+        void saveToFile(std::string filename = "out_default.csv") {
+            std::fstream file;
+            file.open(filename, std::fstream::out | std::fstream::binary);
+            if (!file.is_open()) {
+                std::cout << "\nCouldn't open file: " << filename << "\n";
+                return;
+            }
+            std::cout << "\nSaving current aggregate to: " << filename << std::endl;
+            std::string data = encodeAggregate(filename, H, W, sites);
+            file.write(data.data(), data.size());
+            file.close();
+            std::cout << "Saving done\n";
+        }
+
+        //the same, on the writer's thread: only the list of sites is copied here, the
+        //encoding and writing happen while the simulation goes on
+        void snapshot(AsyncWriter &writer, std::string filename) {
+            int h = H, w = W;
+            std::vector<Site> copy = sites;
+            writer.write(filename, [filename, h, w, copy] { return encodeAggregate(filename, h, w, copy); });
+        }
+
+        //adds the cell (y, x) to the aggregate at time t. false if it was already in it
+        bool stick(int y, int x, int t) {
+            if (!boxes.add(y, x)) return false;
+            sites.push_back(Site{y, x, t});
+            for (int i = -1; i <= 1; i++) {
+                for (int j = -1; j <= 1; j++) {
+                    sticky.set(mod(y+i, H), mod(x+j, W));
+                }
+            }
+            updateBlockDistance(y/blockSize, x/blockSize);
+            updateRadii(y, x);
+            return true;
+        }
+
+        bool occupied(int y, int x) {
+            return boxes.level(0).get(y, x);
+        }
+
+        //memory used by the lattice and the list of sites
+        size_t bytes() {
+            return boxes.bytes() + sticky.bytes() + blockDistance.bytes() + sites.capacity()*sizeof(Site);
+        }
+
+        //accelerated walks (Meakin): a particle far from the aggregate jumps at once
+        //to a random point of the largest circle around it that holds no sticky cell. a
+        //random walk started at the center of a circle leaves it through a uniformly
+        //distributed point, so the jump is statistically the same as the many single
+        //steps it replaces. the free radius comes from a coarse map of the distance to
+        //the aggregate, kept per block of blockSize x blockSize cells
+        //needs both sides to be multiples of blockSize. returns false if they aren't
+        bool enableLongJumps() {
+            if (W % blockSize != 0 || H % blockSize != 0) {
+                std::cout << "Long jumps need a grid whose sides are multiples of " << blockSize << "\n";
+                return false;
+            }
+            longJumps = true;
+            return true;
+        }
+
+        //number of d x d boxes holding at least one cell of the aggregate
+        //read from the pyramid when d is a power of two, counted otherwise
+        long long boxCount(int d) {
+            if (isPowerOfTwo(d)) {
+                int k = 0;
+                while ((1 << k) < d) k++;
+                return (k < boxes.size()) ? boxes.count(k) : 1;
+            }
+            int boxesW = (W + d - 1)/d;
+            std::vector<char> touched((size_t)((H + d - 1)/d)*boxesW, 0);
+            int count = 0;
+            for (size_t i = 0; i < sites.size(); i++) {
+                char &b = touched[(size_t)(sites[i].y/d)*boxesW + sites[i].x/d];
+                if (!b) count++;
+                b = 1;
+            }
+            return count;
+        }
+
+        //box counting dimension: minus the slope of log(boxCount(d)) against log(d),
+        //fitted by least squares over the box sizes d = dMin, 2*dMin, ..., dMax
+        double fractalDimension(int dMin = 2, int dMax = 64) {
+            std::vector<double> d, n;
+            for (int b = dMin; b <= dMax; b *= 2) {
+                d.push_back(b);
+                n.push_back(boxCount(b));
+            }
+            return -fitLogLog(d, n).slope;
+        }
+
+        //mass-radius dimension: slope of log M(r) against log r, where M(r) is the number
+        //of cells within r of the seed, over r = 4 to R_max/2 (beyond it the arms that
+        //are still growing are missing)
+        double massRadiusDimension() {
+            std::vector<double> r, m;
+            long long inside = 0;
+            for (size_t b = 0; b < shells.size(); b++) {
+                inside += shells[b];
+                double radius = pow(2.0, (b+1)/2.0);
+                if (radius >= 4 && radius <= R_max/2) {
+                    r.push_back(radius);
+                    m.push_back(inside);
+                }
+            }
+            return fitLogLog(r, m).slope;
+        }
+
+        //radius of gyration of the aggregate around its center of mass
+        double Rg() {
+            double n = sites.size();
+            double my = sumY/n, mx = sumX/n;
+            return sqrt(sumR2/n - my*my - mx*mx);
+        }
+
+        //dimension from the growth of the radius of gyration: slope of log N against
+        //log Rg, over the values recorded as the aggregate grew from 100 cells on
+        double gyrationDimension() {
+            std::vector<double> n, rg;
+            for (size_t i = 0; i < historyN.size(); i++) {
+                if (historyN[i] < 100) continue;
+                n.push_back(historyN[i]);
+                rg.push_back(historyRg[i]);
+            }
+            return fitLogLog(rg, n).slope;
+        }
+
+    protected:
+        //blockDistance(by, bx) is the Chebyshev distance, in blocks, from block
+        //(by, bx) to the nearest block holding a cell of the aggregate, capped at
+        //maxBlockDistance. a particle in a block at distance k >= 2 is at least
+        //(k-1)*blockSize + 1 cells away from the aggregate
+        static const int blockSize = 8;
+        static const int maxBlockDistance = 64;
+        int blocksW;
+        int blocksH;
+        //(tiled, so that it is only stored around the aggregate)
+        TiledBytes blockDistance;
+
+        //a new aggregate cell in block (by, bx) can only lower the distance of the blocks
+        //around it, so only those are visited, and only the first time the block is reached
+        void updateBlockDistance(int by, int bx) {
+            if (blockDistance.get(by, bx) == 0) return;
+            for (int i = -maxBlockDistance+1; i < maxBlockDistance; i++) {
+                int row = mod(by+i, blocksH);
+                for (int j = -maxBlockDistance+1; j < maxBlockDistance; j++) {
+                    uint8_t d = std::max(abs(i), abs(j));
+                    uint8_t &b = blockDistance.at(row, mod(bx+j, blocksW));
+                    if (d < b) b = d;
+                }
+            }
+        }
+
+        //radius of the jump a particle at (y, x) can take, or 0 if it must walk
+        //the landing point is rounded to the lattice, which can move it up to 1/sqrt(2)
+        //further, and sticky cells reach 1 cell around the aggregate, hence the -2
+        int jumpRadius(int y, int x) {
+            int k = blockDistance.get(y/blockSize, x/blockSize);
+            if (k < 2) return 0;
+            return (k-1)*blockSize - 2;
+        }
+
+        //center of the aggregate (the seed)
+        int cy;
+        int cx;
+        //sums of y, x and y^2 + x^2 over the aggregate, relative to the center
+        double sumY = 0;
+        double sumX = 0;
+        double sumR2 = 0;
+        //shells[b] is the number of cells at a distance from the seed between
+        //2^(b/2) and 2^((b+1)/2) (the seed itself counts in shell 0)
+        std::vector<long long> shells;
+        //number of cells and radius of gyration, recorded every time the aggregate
+        //grows by a factor 2^(1/4)
+        std::vector<double> historyN;
+        std::vector<double> historyRg;
+        double nextRecord = 1;
+
+        //relative to the seed, with the nearest periodic image on the grid
+        void updateRadii(int y, int x) {
+            double dy = y - cy, dx = x - cx;
+            if (dy >= H/2) dy -= H; else if (dy < -H/2) dy += H;
+            if (dx >= W/2) dx -= W; else if (dx < -W/2) dx += W;
+            double r2 = dy*dy + dx*dx;
+            sumY += dy;
+            sumX += dx;
+            sumR2 += r2;
+            R_max = std::max(R_max, sqrt(r2));
+            int b = (r2 < 2) ? 0 : (int)(log2(r2));
+            if (b >= (int)shells.size()) shells.resize(b+1, 0);
+            shells[b]++;
+            if (sites.size() >= nextRecord) {
+                historyN.push_back(sites.size());
+                historyRg.push_back(Rg());
+                while (nextRecord <= sites.size()) nextRecord *= pow(2.0, 0.25);
+            }
+        }
+
+        static bool isPowerOfTwo(int n) {
+            return n > 0 && (n & (n-1)) == 0;
+        }
+
+        //unit vectors for the long jumps, at 1024 evenly spaced angles:
+        //cos at [a], sin at [nAngles + a]
+        static const int nAngles = 1024;
+        //(built on first use: a local static is initialized only once, even across threads)
+        static const double *jumpTable() {
+            static const std::vector<double> table = makeJumpTable();
+            return table.data();
+        }
+
+        static std::vector<double> makeJumpTable() {
+            std::vector<double> t(2*nAngles);
+            for (int a = 0; a < nAngles; a++) {
+                t[a] = cos(2*M_PI*a/nAngles);
+                t[nAngles+a] = sin(2*M_PI*a/nAngles);
+            }
+            return t;
+        }
+
+};
+
+class Grid : public Aggregate<Bitmap> {
+
+    public:
+        int maxParticles;
+        int stp = 0;
+        Walkers particles;
+        //random generator used for the particles (xoshiro256++, see Common/Random.h)
+        Random rng;
+
+        Grid(int h, int w, int N, unsigned long seed) : Aggregate<Bitmap>(h, w) {
+            rng.seed(seed);
+            uint64_t z = seed;
+            walkKey = Random::splitmix64(z);
+            maxParticles = N;
+            std::cout << "Grid size: " << W << " x " << H << " = " << W*H << " cells\n";
+            //populate the grid
+            for (int i = 0; i < N; i++) {
+                int y = rng.below(H);
+                int x = rng.below(W);
+                particles.add(y, x);
+            }
+            std::cout << "Created: " << particles.size() << " particles\n";
+
+            //place seed
+            stick(H/2, W/2, 1);
+            std::cout << "Placed seed at: " << H/2 << ", " << W/2 << "\n";
+        }
+
+        bool updateParticles() {
+            //if there are less than 5% of particles left, we exit (takes too long if not)
+            if ( (double)(particles.size())/maxParticles < 0.05) {
+                std::cout << "\n5% of particles left. Updating done...\n";
+                return false;
+            }
+            //power of two sides wrap around with a mask instead of a compare
+            bool powerOfTwo = isPowerOfTwo(W) && isPowerOfTwo(H);
+            int attached = sites.size();
+            if (pool) {
+                if (longJumps) {
+                    if (powerOfTwo) moveParticlesParallel<true, true>();
+                    else moveParticlesParallel<false, true>();
+                }
+                else {
+                    if (powerOfTwo) moveParticlesParallel<true, false>();
+                    else moveParticlesParallel<false, false>();
+                }
+            }
+            else {
+                //the serial engine sticks particles as it moves them, so both are timed as
+                //moving there
+                Profiler::Timer timer(profiler, movePhase, particles.size());
+                if (longJumps) {
+                    if (powerOfTwo) moveParticles<true, true>();
+                    else moveParticles<false, true>();
+                }
+                else {
+                    if (powerOfTwo) moveParticles<true, false>();
+                    else moveParticles<false, false>();
+                }
+            }
+            if (profiler) profiler->count(stickPhase, sites.size() - attached);
+            stp++;
+            return true;
+        }
+
+        //parallel engine: the particles are split in nThreads contiguous ranges, moved
+        //at the same time. each particle takes its random numbers from a hash of the seed,
+        //its id and the step, instead of from rng, so they don't depend on which thread
+        //moves it. all particles decide whether they stick against the aggregate as it
+        //was at the start of the step, and the ones that do are attached afterwards, on
+        //one thread and in order. so a given seed grows the same aggregate for any number
+        //of threads (but not the same one as the serial engine, where a particle that
+        //sticks can already catch others later in the same step)
+        void setThreads(int nThreads) {
+            pool.reset(new ThreadPool(nThreads));
+        }
+
+        //times every step in profiler: "move" (items: particles moved or tested) and
+        //"stick" (items: particles attached). NULL stops it
+        void setProfiler(Profiler *profiler_) {
+            profiler = profiler_;
+            if (profiler) {
+                movePhase = profiler->phase("move");
+                stickPhase = profiler->phase("stick");
+            }
+        }
+
+        ~Grid() {}
+
+    private:
+        //random directions for the current step, 2 bits per particle (32 per word)
+        std::vector<uint64_t> directions;
+        //parallel engine, see setThreads()
+        std::unique_ptr<ThreadPool> pool;
+        uint64_t walkKey;
+        std::vector<char> stuck;
+        Profiler *profiler = NULL;
+        int movePhase;
+        int stickPhase;
+
+        //moves particle i one cell in direction d: 0 = up, 1 = right, 2 = down, 3 = left
+        template <bool powerOfTwo>
+        void stepParticle(int i, int d) {
+            static const int dy[4] = {-1, 0, 1, 0};
+            static const int dx[4] = {0, 1, 0, -1};
+            int y = particles.y[i] + dy[d];
+            int x = particles.x[i] + dx[d];
+            if (powerOfTwo) {
+                y &= H-1;
+                x &= W-1;
+            }
+            else {
+                if (y < 0) y += H; else if (y >= H) y -= H;
+                if (x < 0) x += W; else if (x >= W) x -= W;
+            }
+            particles.y[i] = y;
+            particles.x[i] = x;
+        }
+
+        //moves particle i r cells away, at angle number a, and puts it to rest
+        //a walk leaves a circle of radius r after r^2 steps on average, so after a jump
+        //the particle rests for r^2 steps. this keeps every particle on the same clock:
+        //otherwise far particles would reach the aggregate much sooner than near ones and
+        //the growth (and its fractal dimension) would change. a resting particle still
+        //sticks as soon as the aggregate grows next to its cell
+        template <bool powerOfTwo>
+        void jumpParticle(int i, int r, int a, const double *table) {
+            int y = particles.y[i] + (int)lround(r*table[nAngles+a]);
+            int x = particles.x[i] + (int)lround(r*table[a]);
+            particles.wake[i] = stp + r*r;
+            if (powerOfTwo) {
+                y &= H-1;
+                x &= W-1;
+            }
+            else {
+                y = mod(y, H);
+                x = mod(x, W);
+            }
+            particles.y[i] = y;
+            particles.x[i] = x;
+        }
+
+        //sticks the particles next to the aggregate, and moves the rest one cell
+        //in a random direction, or jumps them. a particle on a cell that another one has
+        //already taken doesn't stick, but walks on, so no particle is lost
+        template <bool powerOfTwo, bool jumps>
+        void moveParticles() {
+            const double *table = jumps ? jumpTable() : NULL;
+            int n = particles.size();
+            directions.resize((n + 31)/32);
+            rng.fillBits(directions.data(), directions.size());
+            for (int i = 0; i < n; ) {
+                if (sticky.get(particles.y[i], particles.x[i]) &&
+                    stick(particles.y[i], particles.x[i], 1+stp)) {
+                    //the last particle takes this place, and is moved next,
+                    //with the direction bits of this index
+                    particles.remove(i);
+                    n--;
+                    continue;
+                }
+                //a particle still in the middle of a jump is left alone
+                if (jumps && particles.wake[i] > stp) {
+                    i++;
+                    continue;
+                }
+                int r = jumps ? jumpRadius(particles.y[i], particles.x[i]) : 0;
+                if (r > 0) jumpParticle<powerOfTwo>(i, r, rng.next() >> 54, table);
+                else stepParticle<powerOfTwo>(i, (directions[i/32] >> (2*(i%32))) & 3);
+                i++;
+            }
+        }
+
+        //the same, for particles begin to end-1 of the parallel engine. only reads the
+        //aggregate, and marks the particles that stick in stuck[]
+        template <bool powerOfTwo, bool jumps>
+        void moveRange(int begin, int end) {
+            const double *table = jumps ? jumpTable() : NULL;
+            for (int i = begin; i < end; i++) {
+                //an occupied cell can't be taken again: the particle walks on instead
+                if (sticky.get(particles.y[i], particles.x[i]) && !occupied(particles.y[i], particles.x[i])) {
+                    stuck[i] = 1;
+                    continue;
+                }
+                if (jumps && particles.wake[i] > stp) continue;
+                //counter based random bits: distinct (id, step) pairs give distinct
+                //inputs, and splitmix64 mixes them into independent looking words
+                uint64_t z = walkKey ^ ((uint64_t)particles.id[i] << 32 | (uint32_t)stp);
+                uint64_t bits = Random::splitmix64(z);
+                int r = jumps ? jumpRadius(particles.y[i], particles.x[i]) : 0;
+                if (r > 0) jumpParticle<powerOfTwo>(i, r, bits >> 54, table);
+                else stepParticle<powerOfTwo>(i, bits >> 62);
+            }
+        }
+
+        template <bool powerOfTwo, bool jumps>
+        void moveParticlesParallel() {
+            int n = particles.size();
+            stuck.assign(n, 0);
+            int nThreads = pool->size();
+            {
+                Profiler::Timer timer(profiler, movePhase, n);
+                for (int t = 0; t < nThreads; t++) {
+                    int begin = (long long)n*t/nThreads;
+                    int end = (long long)n*(t+1)/nThreads;
+                    pool->submit([this, begin, end] { moveRange<powerOfTwo, jumps>(begin, end); });
+                }
+                pool->wait();
+            }
+            //attach in order, so the result doesn't depend on the ranges. of several
+            //particles on the same cell only the first one sticks, and the others stay
+            Profiler::Timer timer(profiler, stickPhase);
+            for (int i = 0; i < n; i++) {
+                if (stuck[i]) stuck[i] = stick(particles.y[i], particles.x[i], 1+stp);
+            }
+            particles.removeMarked(stuck);
+        }
+};
+
+//angle of the point where a random walk started at (dy, dx) first reaches the circle
+//of radius R around the origin. inside the circle ((0, 0) in particular) any angle is
+//as likely. from outside, the angle around the direction of (dy, dx) follows a wrapped
+//Cauchy distribution of parameter R/distance (the exterior Poisson kernel), sampled by
+//inverting its cumulative
+inline double hittingAngle(Random &rng, double R, double dy, double dx) {
+    double rho = sqrt(dy*dy + dx*dx);
+    double a = 2*M_PI*rng.uniform();
+    if (rho > R) {
+        double p = R/rho;
+        double theta = 2*atan((1-p)/(1+p)*tan(M_PI*(rng.uniform()-0.5)));
+        a = atan2(dy, dx) + theta;
+    }
+    return a;
+}
+
+//single walker DLA: particles are launched one at a time from a circle just outside
+//the aggregate, and walk until they stick. the aggregate grows around the center of a
+//size x size lattice, which only needs to hold the kill circle (see killRadius)
+//outside the circle of radius R_max that holds the whole aggregate, a walker jumps at
+//once to a random point of the largest circle around it that stays outside of it. a
+//walker that gets beyond the kill circle is put straight back on the launch circle, at
+//the point where a walk from there would first hit it (the exterior Poisson kernel),
+//so no walk is cut short and the launch circle can stay close to the aggregate
+//with enableLongJumps(), walkers inside R_max also jump, using the block distance map
+//the aggregate is usually stored in tiles (see TiledBitmap), so the lattice can be much
+//larger than the cluster: only the tiles it reaches are allocated
+template <class Lattice>
+class ClusterOf : public Aggregate<Lattice> {
+
+    typedef Aggregate<Lattice> Base;
+
+    public:
+        using Base::W;
+        using Base::H;
+        using Base::sticky;
+        using Base::sites;
+        using Base::longJumps;
+        using Base::R_max;
+
+        //number of single steps and jumps made by all walkers
+        long long moves = 0;
+        //random generator used for the walkers (xoshiro256++, see Common/Random.h)
+        Random rng;
+
+        ClusterOf(int size, unsigned long seed) : Base(size, size) {
+            rng.seed(seed);
+            attach(cy, cx);
+        }
+
+        //the walkers start at a uniformly distributed point of this circle
+        double launchRadius() {
+            return R_max + 5;
+        }
+
+        //and are put back on it when they get beyond this one
+        double killRadius() {
+            return 1.5*launchRadius() + 10;
+        }
+
+        //launches one walker and moves it until it sticks
+        //returns false (and adds nothing) if the kill circle doesn't fit in the lattice
+        bool addParticle() {
+            if (killRadius() + 2 >= W/2) {
+                std::cout << "\nThe aggregate has reached the size of the lattice ("
+                          << W << " x " << H << ")\n";
+                return false;
+            }
+            double fy, fx;
+            launch(0, 0, fy, fx);
+            int y = lround(fy), x = lround(fx);
+            while (!sticky.get(y, x)) {
+                moves++;
+                double dy = y - cy, dx = x - cx;
+                double rho = sqrt(dy*dy + dx*dx);
+                //free radius: cells of the aggregate are within R_max of the center,
+                //sticky cells within R_max + sqrt(2), and rounding the landing point to the
+                //lattice can move it 1/sqrt(2) further
+                double r = rho - R_max - 3;
+                if (r < 2 && longJumps) r = jumpRadius(y, x);
+                if (r >= 2) {
+                    double a = 2*M_PI*rng.uniform();
+                    fy = y + r*sin(a);
+                    fx = x + r*cos(a);
+                }
+                else {
+                    //single step, using 2 bits of the buffered random word
+                    if (bitsLeft == 0) {
+                        bits = rng.next();
+                        bitsLeft = 32;
+                    }
+                    int d = bits & 3;
+                    bits >>= 2;
+                    bitsLeft--;
+                    fy = y + ((d == 0) ? -1 : (d == 2) ? 1 : 0);
+                    fx = x + ((d == 1) ? 1 : (d == 3) ? -1 : 0);
+                }
+                dy = fy - cy;
+                dx = fx - cx;
+                if (dy*dy + dx*dx > killRadius()*killRadius()) launch(dy, dx, fy, fx);
+                y = lround(fy);
+                x = lround(fx);
+            }
+            attach(y, x);
+            return true;
+        }
+
+    private:
+        using Base::cy;
+        using Base::cx;
+        using Base::jumpRadius;
+        using Base::stick;
+
+        //random bits for the single steps
+        uint64_t bits = 0;
+        int bitsLeft = 0;
+
+        //adds (y, x) to the aggregate, with the number of the particle as its time
+        void attach(int y, int x) {
+            stick(y, x, sites.size()+1);
+        }
+
+        //puts a walker at (dy, dx) from the center on the launch circle, at the point
+        //where a walk from (dy, dx) would first reach it
+        void launch(double dy, double dx, double &fy, double &fx) {
+            double R = launchRadius();
+            double a = hittingAngle(rng, R, dy, dx);
+            fy = cy + R*sin(a);
+            fx = cx + R*cos(a);
+        }
+};
+
+typedef ClusterOf<TiledBitmap> Cluster;
+typedef ClusterOf<Bitmap> DenseCluster;
+
+#endif
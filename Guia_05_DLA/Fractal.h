@@ -0,0 +1,114 @@
+//Fractal dimension of a lattice aggregate, computed in memory while it grows
+//box counting over every power of two box size at once, from a pyramid of bitmaps,
+//and straight line fits in log-log scale for the box counting, mass-radius and
+//radius of gyration scalings
+
+#ifndef FRACTAL_H
+#define FRACTAL_H
+
+#include <vector>
+#include <cmath>
+
+#include "Bitmap.h"
+
+//level k of the pyramid marks the 2^k x 2^k boxes that hold at least one cell of the
+//aggregate (level 0 is the aggregate itself). each level is the OR of 2 x 2 blocks of
+//the one below, so the number of occupied boxes of every size is kept at once
+//the pyramid can be built from a bitmap in one pass per level (build), or kept up to
+//date as cells are added (add): a new cell only sets bits up to the first level where
+//its box was already occupied, so adding costs O(1) on average and the counts are
+//always ready. Lattice is Bitmap or TiledBitmap (see Bitmap.h)
+template <class Lattice = Bitmap>
+class BoxPyramid {
+    public:
+        BoxPyramid() {}
+
+        //empty pyramid for an h x w lattice, with levels up to boxes of the whole lattice
+        BoxPyramid(int h, int w) {
+            levels.push_back(Lattice(h, w));
+            while (levels.back().H > 1 || levels.back().W > 1) {
+                levels.push_back(Lattice((levels.back().H + 1)/2, (levels.back().W + 1)/2));
+            }
+            counts.assign(levels.size(), 0);
+        }
+
+        //pyramid of the cells set in base, by repeated OR reduction
+        void build(Lattice &base) {
+            levels.clear();
+            levels.push_back(base);
+            while (levels.back().H > 1 || levels.back().W > 1) {
+                levels.push_back(levels.back().halved());
+            }
+            counts.resize(levels.size());
+            for (size_t k = 0; k < levels.size(); k++) counts[k] = levels[k].count();
+        }
+
+        //adds the cell (y, x). returns false if it was already there
+        bool add(int y, int x) {
+            if (levels[0].get(y, x)) return false;
+            for (size_t k = 0; k < levels.size(); k++) {
+                if (levels[k].get(y, x)) break;
+                levels[k].set(y, x);
+                counts[k]++;
+                y >>= 1;
+                x >>= 1;
+            }
+            return true;
+        }
+
+        int size() {
+            return levels.size();
+        }
+
+        size_t bytes() {
+            size_t b = 0;
+            for (size_t k = 0; k < levels.size(); k++) b += levels[k].bytes();
+            return b;
+        }
+
+        Lattice &level(int k) {
+            return levels[k];
+        }
+
+        //number of occupied 2^k x 2^k boxes
+        long long count(int k) {
+            return counts[k];
+        }
+
+    private:
+        std::vector<Lattice> levels;
+        std::vector<long long> counts;
+};
+
+//least squares straight line y = slope*x + intercept
+struct LineFit {
+    double slope = 0;
+    double intercept = 0;
+    int points = 0;
+};
+
+inline LineFit fitLine(const std::vector<double> &x, const std::vector<double> &y) {
+    LineFit f;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int n = x.size();
+    for (int i = 0; i < n; i++) {
+        sx += x[i]; sy += y[i]; sxx += x[i]*x[i]; sxy += x[i]*y[i];
+    }
+    f.points = n;
+    if (n < 2) return f;
+    f.slope = (n*sxy - sx*sy)/(n*sxx - sx*sx);
+    f.intercept = (sy - f.slope*sx)/n;
+    return f;
+}
+
+//the same, after taking logs of both coordinates
+inline LineFit fitLogLog(const std::vector<double> &x, const std::vector<double> &y) {
+    std::vector<double> lx(x.size()), ly(y.size());
+    for (size_t i = 0; i < x.size(); i++) {
+        lx[i] = log(x[i]);
+        ly[i] = log(y[i]);
+    }
+    return fitLine(lx, ly);
+}
+
+#endif
@@ -0,0 +1,186 @@
+//Off lattice diffusion limited aggregation
+//the same single walker growth as Cluster (see DLA.h), with disks of radius 1 at
+//continuous positions instead of lattice cells, which removes the anisotropy of the
+//lattice. every disk also marks the unit cell holding its center in the underlying
+//Aggregate, so box counting, radii, output and snapshots work as for the lattice
+
+#ifndef OFFLATTICE_H
+#define OFFLATTICE_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+
+#include "DLA.h"
+
+//a walker moves in a random direction by the largest step that can't reach any disk:
+//outside R_max from the distance to the center, far inside from the block distance
+//map, and near the aggregate from the nearest disk, found in a spatial hash of 2 x 2
+//cells (a disk center within distance 4 is always in the 5 x 5 cells around the
+//walker). once the nearest disk is closer than 3, the walker takes unit steps, and
+//sticks at the first contact along the step
+class OffLatticeCluster : public Aggregate<TiledBitmap> {
+
+    public:
+        //centers of the disks, in the order they were attached
+        std::vector<double> py;
+        std::vector<double> px;
+        //number of steps and jumps made by all walkers
+        long long moves = 0;
+        //random generator used for the walkers (xoshiro256++, see Common/Random.h)
+        Random rng;
+
+        OffLatticeCluster(int size, unsigned long seed) : Aggregate<TiledBitmap>(size, size) {
+            rng.seed(seed);
+            cellsH = (size + 1)/2;
+            cellsW = (size + 1)/2;
+            head = TiledArray<int32_t>(cellsH, cellsW, -1);
+            attach(cy + 0.5, cx + 0.5);
+        }
+
+        //the walkers start at a uniformly distributed point of this circle
+        double launchRadius() {
+            return reach + 5;
+        }
+
+        //and are put back on it when they get beyond this one
+        double killRadius() {
+            return 1.5*launchRadius() + 10;
+        }
+
+        //launches one walker and moves it until it sticks
+        //returns false (and adds nothing) if the kill circle doesn't fit in the lattice
+        bool addParticle() {
+            if (killRadius() + 4 >= W/2) {
+                std::cout << "\nThe aggregate has reached the size of the lattice ("
+                          << W << " x " << H << ")\n";
+                return false;
+            }
+            double y, x;
+            launch(0, 0, y, x);
+            while (true) {
+                moves++;
+                double dy = y - (cy + 0.5), dx = x - (cx + 0.5);
+                double rho2 = dy*dy + dx*dx;
+                if (rho2 > killRadius()*killRadius()) {
+                    launch(dy, dx, y, x);
+                    continue;
+                }
+                //free distance: every disk center is within reach of the seed, and touching
+                //a disk means getting within 2 of its center
+                double r = sqrt(rho2) - reach - 2;
+                if (r < 2) {
+                    int k = blockDistance.get((int)y/blockSize, (int)x/blockSize);
+                    if (k >= 2) r = (k-1)*blockSize - 2;
+                }
+                double a = 2*M_PI*rng.uniform();
+                double uy = sin(a), ux = cos(a);
+                if (r < 2) {
+                    double d = nearest(y, x);
+                    r = (d > 4) ? 2 : d - 2;
+                    if (r < 1) {
+                        double t = contact(y, x, uy, ux, 1.0);
+                        if (t >= 0) {
+                            attach(y + t*uy, x + t*ux);
+                            return true;
+                        }
+                        r = 1;
+                    }
+                }
+                y += r*uy;
+                x += r*ux;
+            }
+        }
+
+        //the centers, one "x y t" line per disk with full precision (the files written by
+        //saveToFile only have the unit cells)
+        void savePositions(std::string filename) {
+            std::fstream file;
+            file.open(filename, std::fstream::out);
+            if (!file.is_open()) {
+                std::cout << "\nCouldn't open file: " << filename << "\n";
+                return;
+            }
+            char line[96];
+            for (int i = 0; i < (int)px.size(); i++) {
+                snprintf(line, sizeof(line), "%.17g %.17g %d\n", px[i], py[i], i+1);
+                file << line;
+            }
+            file.close();
+        }
+
+    private:
+        //largest distance from the seed to a disk center
+        double reach = 0;
+        //spatial hash: head(cy, cx) is the last disk attached with its center in the
+        //2 x 2 cell (cy, cx), or -1, and next[i] the disk attached before i in the same cell
+        int cellsH;
+        int cellsW;
+        TiledArray<int32_t> head;
+        std::vector<int32_t> next;
+
+        void attach(double y, double x) {
+            int i = px.size();
+            py.push_back(y);
+            px.push_back(x);
+            int32_t &h = head.at((int)y/2, (int)x/2);
+            next.push_back(h);
+            h = i;
+            double dy = y - (cy + 0.5), dx = x - (cx + 0.5);
+            reach = std::max(reach, sqrt(dy*dy + dx*dx));
+            stick((int)y, (int)x, i+1);
+        }
+
+        void launch(double dy, double dx, double &y, double &x) {
+            double R = launchRadius();
+            double a = hittingAngle(rng, R, dy, dx);
+            y = cy + 0.5 + R*sin(a);
+            x = cx + 0.5 + R*cos(a);
+        }
+
+        //distance from (y, x) to the nearest disk center in the 5 x 5 hash cells around
+        //it (so exact when it is at most 4), or a large number if there is none
+        double nearest(double y, double x) {
+            int hy = (int)y/2, hx = (int)x/2;
+            double best2 = 1e30;
+            for (int i = hy-2; i <= hy+2; i++) {
+                for (int j = hx-2; j <= hx+2; j++) {
+                    for (int k = head.get(i, j); k >= 0; k = next[k]) {
+                        double dy = py[k] - y, dx = px[k] - x;
+                        best2 = std::min(best2, dy*dy + dx*dx);
+                    }
+                }
+            }
+            return sqrt(best2);
+        }
+
+        //distance along the step of length l from (y, x) in direction (uy, ux) at which
+        //the walker first touches a disk, or -1 if it doesn't. a disk it can touch has its
+        //center within 2 + l <= 3 of (y, x), so within the 5 x 5 hash cells around it
+        double contact(double y, double x, double uy, double ux, double l) {
+            int hy = (int)y/2, hx = (int)x/2;
+            double first = -1;
+            for (int i = hy-2; i <= hy+2; i++) {
+                for (int j = hx-2; j <= hx+2; j++) {
+                    for (int k = head.get(i, j); k >= 0; k = next[k]) {
+                        //|w + t u| = 2, with w from the disk center to the walker
+                        double wy = y - py[k], wx = x - px[k];
+                        double b = wy*uy + wx*ux;
+                        double disc = b*b - (wy*wy + wx*wx - 4);
+                        if (disc < 0) continue;
+                        double t = -b - sqrt(disc);
+                        //both roots behind: moving away from the disk
+                        if (t < 0 && b >= 0) continue;
+                        if (t < 0) t = 0;
+                        if (t <= l && (first < 0 || t < first)) first = t;
+                    }
+                }
+            }
+            return first;
+        }
+};
+
+#endif
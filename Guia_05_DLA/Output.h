@@ -0,0 +1,220 @@
+//Output formats of a DLA aggregate, chosen by the extension of the filename
+//every encoder only takes the size of the lattice and the list of sites, so it can
+//run on a copy of them in a background thread (see Common/AsyncWriter.h)
+//
+// .bin  packed sites: "DLAS", int32 version (1), int32 H, int32 W, int64 n, then n
+//       records of int32 x, y, t (little endian, as the machine writes them). numpy:
+//       np.fromfile(f, dtype=[('x','<i4'),('y','<i4'),('t','<i4')], offset=24)
+// .rle  run length encoded occupancy: "DLAR", int32 version (1), int32 H, int32 W,
+//       then the bounding box of the aggregate as int32 y0, x0, h, w, then for each of
+//       its h rows the lengths of alternating runs of empty and occupied cells,
+//       starting with empty (possibly 0 long) and adding up to w, as LEB128 varints
+// .pgm  8 bit grey image of the bounding box: empty cells black, aggregate cells from
+//       dark (first attached) to white (last attached)
+// .ppm  the same in colour, from blue (first) to red (last)
+//       anything else: the text format, one "x y t" line per site
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "Bitmap.h"
+
+//a cell of the aggregate, and the step at which it was attached
+struct Site {
+    int y;
+    int x;
+    int t;
+};
+
+inline bool hasExtension(const std::string &filename, const std::string &extension) {
+    return filename.size() >= extension.size() &&
+           filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+template <class T>
+void appendRaw(std::string &out, T value) {
+    out.append((const char*)&value, sizeof(T));
+}
+
+inline void appendVarint(std::string &out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+//bounding box of the sites: rows y0 to y0+h-1, columns x0 to x0+w-1
+struct Box {
+    int y0 = 0;
+    int x0 = 0;
+    int h = 0;
+    int w = 0;
+};
+
+inline Box boundingBox(const std::vector<Site> &sites) {
+    Box b;
+    if (sites.empty()) return b;
+    int y1 = sites[0].y, x1 = sites[0].x;
+    b.y0 = y1;
+    b.x0 = x1;
+    for (size_t i = 1; i < sites.size(); i++) {
+        b.y0 = std::min(b.y0, sites[i].y);
+        b.x0 = std::min(b.x0, sites[i].x);
+        y1 = std::max(y1, sites[i].y);
+        x1 = std::max(x1, sites[i].x);
+    }
+    b.h = y1 - b.y0 + 1;
+    b.w = x1 - b.x0 + 1;
+    return b;
+}
+
+inline std::string encodeText(const std::vector<Site> &sites) {
+    std::string out;
+    out.reserve(sites.size()*16);
+    char line[64];
+    for (size_t i = 0; i < sites.size(); i++) {
+        int n = snprintf(line, sizeof(line), "%d %d %d\n", sites[i].x, sites[i].y, sites[i].t);
+        out.append(line, n);
+    }
+    return out;
+}
+
+inline std::string encodeSites(int H, int W, const std::vector<Site> &sites) {
+    std::string out("DLAS");
+    appendRaw<int32_t>(out, 1);
+    appendRaw<int32_t>(out, H);
+    appendRaw<int32_t>(out, W);
+    appendRaw<int64_t>(out, sites.size());
+    out.reserve(out.size() + 12*sites.size());
+    for (size_t i = 0; i < sites.size(); i++) {
+        appendRaw<int32_t>(out, sites[i].x);
+        appendRaw<int32_t>(out, sites[i].y);
+        appendRaw<int32_t>(out, sites[i].t);
+    }
+    return out;
+}
+
+inline std::string encodeRLE(int H, int W, const std::vector<Site> &sites) {
+    Box b = boundingBox(sites);
+    std::string out("DLAR");
+    appendRaw<int32_t>(out, 1);
+    appendRaw<int32_t>(out, H);
+    appendRaw<int32_t>(out, W);
+    appendRaw<int32_t>(out, b.y0);
+    appendRaw<int32_t>(out, b.x0);
+    appendRaw<int32_t>(out, b.h);
+    appendRaw<int32_t>(out, b.w);
+    Bitmap cells(b.h, b.w);
+    for (size_t i = 0; i < sites.size(); i++) cells.set(sites[i].y - b.y0, sites[i].x - b.x0);
+    //runs are found a word at a time: the next change of value is the lowest bit set
+    //in the word, or in its complement
+    for (int y = 0; y < b.h; y++) {
+        const uint64_t *row = &cells.words[(size_t)y*cells.wordsPerRow];
+        int x = 0;
+        bool value = false;
+        while (x < b.w) {
+            int start = x;
+            while (x < b.w) {
+                uint64_t word = row[x/64] >> (x%64);
+                if (value) word = ~word;
+                int offset = word ? __builtin_ctzll(word) : 64 - x%64;
+                if (word && offset < 64 - x%64) {
+                    x += offset;
+                    break;
+                }
+                x += 64 - x%64;
+            }
+            if (x > b.w) x = b.w;
+            appendVarint(out, x - start);
+            value = !value;
+        }
+    }
+    return out;
+}
+
+//grey (or colour) image of the bounding box, with the attachment times as intensity
+inline std::string encodeImage(const std::vector<Site> &sites, bool colour) {
+    Box b = boundingBox(sites);
+    int tMin = 0, tMax = 0;
+    if (!sites.empty()) {
+        tMin = tMax = sites[0].t;
+        for (size_t i = 1; i < sites.size(); i++) {
+            tMin = std::min(tMin, sites[i].t);
+            tMax = std::max(tMax, sites[i].t);
+        }
+    }
+    int channels = colour ? 3 : 1;
+    std::string out = std::string(colour ? "P6\n" : "P5\n") + std::to_string(b.w) + " " + std::to_string(b.h) + "\n255\n";
+    size_t header = out.size();
+    out.resize(header + (size_t)b.w*b.h*channels, 0);
+    for (size_t i = 0; i < sites.size(); i++) {
+        //from 55 to 255, so that the first cells still stand out from the background
+        double f = (tMax > tMin) ? (double)(sites[i].t - tMin)/(tMax - tMin) : 1.0;
+        char *pixel = &out[header + ((size_t)(sites[i].y - b.y0)*b.w + (sites[i].x - b.x0))*channels];
+        if (colour) {
+            pixel[0] = (char)(uint8_t)(255*f);
+            pixel[1] = (char)(uint8_t)(255*(1 - 2*std::abs(f - 0.5)));
+            pixel[2] = (char)(uint8_t)(255*(1 - f));
+        }
+        else pixel[0] = (char)(uint8_t)(55 + 200*f);
+    }
+    return out;
+}
+
+//true unless the extension of filename is one of the binary formats
+inline bool isTextFormat(const std::string &filename) {
+    return !(hasExtension(filename, ".bin") || hasExtension(filename, ".rle") ||
+             hasExtension(filename, ".pgm") || hasExtension(filename, ".ppm"));
+}
+
+//the file for filename, in the format given by its extension
+inline std::string encodeAggregate(const std::string &filename, int H, int W, const std::vector<Site> &sites) {
+    if (hasExtension(filename, ".bin")) return encodeSites(H, W, sites);
+    if (hasExtension(filename, ".rle")) return encodeRLE(H, W, sites);
+    if (hasExtension(filename, ".pgm")) return encodeImage(sites, false);
+    if (hasExtension(filename, ".ppm")) return encodeImage(sites, true);
+    return encodeText(sites);
+}
+
+//reads a .bin file written by encodeSites. returns false if it can't
+inline bool readSites(const std::string &filename, int &H, int &W, std::vector<Site> &sites) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        std::cout << "Couldn't open file: " << filename << "\n";
+        return false;
+    }
+    char magic[4];
+    int32_t version, h, w;
+    int64_t n;
+    file.read(magic, 4);
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)&h, sizeof(h));
+    file.read((char*)&w, sizeof(w));
+    file.read((char*)&n, sizeof(n));
+    if (!file || std::memcmp(magic, "DLAS", 4) != 0 || version != 1 || n < 0) {
+        std::cout << "Not a DLA sites file: " << filename << "\n";
+        return false;
+    }
+    std::vector<int32_t> records(3*n);
+    file.read((char*)records.data(), records.size()*sizeof(int32_t));
+    if (!file) {
+        std::cout << "File is truncated: " << filename << "\n";
+        return false;
+    }
+    H = h;
+    W = w;
+    sites.resize(n);
+    for (int64_t i = 0; i < n; i++) sites[i] = Site{records[3*i+1], records[3*i], records[3*i+2]};
+    return true;
+}
+
+#endif
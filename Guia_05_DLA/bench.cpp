@@ -0,0 +1,304 @@
+// Walker throughput benchmark of the DLA grid
+// runs the current Grid and the original list based implementation on the
+// 1024 x 1024, 20000 particle setup of main.cpp and reports walker-steps per second
+// "scaling" runs the parallel engine instead, on a 4096 x 4096 grid with 10^6 particles,
+// for 1 to 32 threads, and checks that every thread count grows the same aggregate
+// "fractal" grows a single walker cluster, measuring its fractal dimension every 1000
+// particles, and reports the cost of the measurements against the growth
+// "sparse" grows the same single walker cluster with dense and tiled lattices, and
+// reports their memory and speed
+// "output" saves a single walker cluster in every format, and compares the time a
+// background snapshot takes from the simulation with a direct save
+// "offlattice" grows an off lattice cluster (OffLattice.h), and reports its speed, memory
+// and fractal dimensions next to those of a lattice cluster of the same size
+// "mass" grows the 1024 x 1024, 20000 particle grid with long jumps, serial and on 2
+// threads, and checks after every step that no particle is lost: the cells of the
+// aggregate plus the walkers left stay 20001 (the seed and the 20000 particles)
+// compilation: g++ -O3 -std=c++11 -pthread -o bench bench.cpp
+// usage: ./bench [steps] (default 2000)
+//        ./bench scaling [steps] (default 200)
+//        ./bench fractal [cells] (default 200000)
+//        ./bench sparse [cells] (default 200000)
+//        ./bench output [cells] (default 200000)
+//        ./bench offlattice [cells] (default 1000000)
+//        ./bench mass [steps] (default 50000)
+
+#include <iostream>
+#include <list>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "DLA.h"
+#include "OffLattice.h"
+
+using namespace std;
+
+//the original implementation: a std::list of particles, a global mt19937
+//and a new distribution built for every random direction
+mt19937 legacyGen(1);
+
+class LegacyParticle {
+    public:
+        int y;
+        int x;
+        LegacyParticle(int Y, int X) {
+            y = Y;
+            x = X;
+        }
+};
+
+class LegacyGrid {
+    public:
+        int W;
+        int H;
+        int stp = 0;
+        list<LegacyParticle> particles;
+        vector<vector<int>> aggregate;
+
+        LegacyGrid(int h, int w, int N) {
+            W = w;
+            H = h;
+            uniform_int_distribution<> distribY(0, H-1);
+            uniform_int_distribution<> distribX(0, W-1);
+            for (int i = 0; i < N; i++) particles.push_back(LegacyParticle(distribY(legacyGen), distribX(legacyGen)));
+            aggregate.assign(H, vector<int>(W, 0));
+            aggregate[H/2][W/2] = 1;
+        }
+
+        void updateParticles() {
+            for (auto i = particles.begin(); i != particles.end(); ) {
+                if (fixedNear(i->y, i->x)) {
+                    aggregate[i->y][i->x] = 1+stp;
+                    i = particles.erase(i);
+                }
+                else {
+                    switch(uniform_int_distribution<int>{0, 3}(legacyGen)) {
+                        case 0: i->y -= 1; break;
+                        case 1: i->x += 1; break;
+                        case 2: i->y += 1; break;
+                        case 3: i->x -= 1; break;
+                    }
+                    i->y = mod(i->y, H);
+                    i->x = mod(i->x, W);
+                    i++;
+                }
+            }
+            stp++;
+        }
+
+    private:
+        bool fixedNear(int y, int x) {
+            for (int i = -1; i <= 1; i++) {
+                for (int j = -1; j <= 1; j++) {
+                    if (aggregate[mod(y+i, H)][mod(x+j, W)] >= 1) return true;
+                }
+            }
+            return false;
+        }
+};
+
+//walker-steps per second of the parallel engine for 1, 2, 4, ..., 32 threads
+int scaling(int steps) {
+    vector<Site> reference;
+    double rate1 = 0;
+    cout << "\n" << steps << " steps, 4096 x 4096, 1000000 particles\n";
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        Grid g(4096, 4096, 1000000, 1);
+        g.setThreads(threads);
+        //one untimed step, so that every run starts with its memory already touched
+        g.updateParticles();
+        double walkerSteps = 0;
+        auto start = chrono::steady_clock::now();
+        for (int s = 0; s < steps; s++) {
+            walkerSteps += g.particles.size();
+            g.updateParticles();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double rate = walkerSteps/seconds;
+        if (threads == 1) {
+            reference = g.sites;
+            rate1 = rate;
+        }
+        bool same = g.sites.size() == reference.size();
+        for (size_t i = 0; same && i < g.sites.size(); i++) {
+            same = g.sites[i].y == reference[i].y && g.sites[i].x == reference[i].x && g.sites[i].t == reference[i].t;
+        }
+        cout << " " << threads << " threads: " << rate/1e6 << " M walker-steps/s (x" << rate/rate1 << "), "
+             << g.sites.size() << " cells, " << (same ? "same aggregate" : "DIFFERENT aggregate") << "\n";
+        if (!same) return -1;
+    }
+    cout << "(" << thread::hardware_concurrency() << " hardware threads available)\n";
+    return 0;
+}
+
+//cost of the in memory fractal analysis (Fractal.h) during the growth of a cluster
+int fractal(int cells) {
+    Cluster c(8192, 1);
+    c.enableLongJumps();
+    double growSeconds = 0, analysisSeconds = 0;
+    double D = 0, Dm = 0, Dg = 0;
+    int calls = 0;
+    while ((int)c.sites.size() < cells) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < 1000 && c.addParticle(); i++) {}
+        auto middle = chrono::steady_clock::now();
+        D = c.fractalDimension();
+        Dm = c.massRadiusDimension();
+        Dg = c.gyrationDimension();
+        calls++;
+        auto end = chrono::steady_clock::now();
+        growSeconds += chrono::duration<double>(middle - start).count();
+        analysisSeconds += chrono::duration<double>(end - middle).count();
+    }
+    cout << "\n" << c.sites.size() << " cells, R_max " << c.R_max << ", Rg " << c.Rg() << "\n";
+    cout << " box counting D = " << D << ", mass-radius D = " << Dm << ", gyration D = " << Dg << "\n";
+    cout << " growth: " << growSeconds << " s, " << calls << " analyses: " << analysisSeconds
+         << " s (" << analysisSeconds/calls*1e6 << " us each)\n";
+
+    //the same counts, from a pyramid rebuilt from scratch by OR reduction
+    auto start = chrono::steady_clock::now();
+    BoxPyramid<TiledBitmap> rebuilt;
+    rebuilt.build(c.boxes.level(0));
+    double buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    bool same = rebuilt.size() == c.boxes.size();
+    for (int k = 0; same && k < rebuilt.size(); k++) same = rebuilt.count(k) == c.boxes.count(k);
+    cout << " rebuilding the pyramid of the 8192^2 lattice: " << buildSeconds*1e3 << " ms, "
+         << (same ? "same counts" : "DIFFERENT counts") << "\n";
+    return same ? 0 : -1;
+}
+
+//grows a cluster of the given number of cells, and reports its memory and moves per second
+template <class Model>
+void growCluster(string name, int size, int cells) {
+    Model c(size, 1);
+    c.enableLongJumps();
+    auto start = chrono::steady_clock::now();
+    while ((int)c.sites.size() < cells && c.addParticle()) {}
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << " " << name << size << "^2: " << c.bytes()/1048576.0 << " MB, " << seconds << " s, "
+         << c.moves/seconds/1e6 << " M moves/s (R_max " << c.R_max << ")\n";
+}
+
+int sparse(int cells) {
+    cout << "\n" << cells << " cells, single walker with long jumps\n";
+    growCluster<DenseCluster>("dense ", 16384, cells);
+    growCluster<Cluster>("tiled ", 16384, cells);
+    growCluster<Cluster>("tiled ", 65536, cells);
+    growCluster<Cluster>("tiled ", 262144, cells);
+    cout << " (a dense 65536^2 lattice would need " << 2*65536.0*65536/8*4/3/1048576 << " MB for its bitmaps alone)\n";
+    return 0;
+}
+
+int output(int cells) {
+    Cluster c(16384, 1);
+    c.enableLongJumps();
+    while ((int)c.sites.size() < cells && c.addParticle()) {}
+    cout << "\n" << c.sites.size() << " cells, saved to bench_out.*\n";
+    string extensions[5] = {".txt", ".bin", ".rle", ".pgm", ".ppm"};
+    for (int i = 0; i < 5; i++) {
+        string filename = "bench_out" + extensions[i];
+        auto start = chrono::steady_clock::now();
+        string data = encodeAggregate(filename, c.H, c.W, c.sites);
+        ofstream file(filename, ios::out | ios::binary);
+        file.write(data.data(), data.size());
+        file.close();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << " " << extensions[i] << ": " << data.size()/1048576.0 << " MB in " << seconds*1e3 << " ms\n";
+    }
+    AsyncWriter writer;
+    auto start = chrono::steady_clock::now();
+    c.snapshot(writer, "bench_out.pgm");
+    double stall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    writer.wait();
+    double total = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << " background .pgm snapshot: " << stall*1e3 << " ms taken from the simulation, "
+         << total*1e3 << " ms until written\n";
+    return writer.ok() ? 0 : -1;
+}
+
+//grows a cluster of the given number of cells, and reports its speed, memory and dimensions
+template <class Model>
+void growDimensions(string name, Model &c, int cells) {
+    auto start = chrono::steady_clock::now();
+    while ((int)c.sites.size() < cells && c.addParticle()) {}
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << " " << name << c.sites.size() << " in " << seconds << " s, " << c.moves/seconds/1e6
+         << " M moves/s, " << c.bytes()/1048576.0 << " MB\n";
+    cout << "   R_max " << c.R_max << ", Rg " << c.Rg() << ", dimensions: box counting "
+         << c.fractalDimension() << ", mass-radius " << c.massRadiusDimension()
+         << ", gyration " << c.gyrationDimension() << "\n";
+}
+
+int offLattice(int cells) {
+    cout << "\n" << cells << " particles, single walker\n";
+    OffLatticeCluster disks(32768, 1);
+    growDimensions("off lattice disks: ", disks, cells);
+    Cluster lattice(32768, 1);
+    lattice.enableLongJumps();
+    growDimensions("lattice cells (long jumps): ", lattice, cells);
+    return 0;
+}
+
+//steps steps of the 1024 x 1024 grid with long jumps, on threads threads (0: serial).
+//false if the aggregate and the walkers ever hold other than the seed and the 20000
+//particles
+bool conservesMass(int threads, int steps) {
+    Grid g(1024, 1024, 20000, 1);
+    g.enableLongJumps();
+    if (threads > 0) g.setThreads(threads);
+    int s = 0;
+    bool conserved = true;
+    for (; s < steps && conserved; s++) {
+        if (!g.updateParticles()) break;
+        conserved = g.sites.size() + g.particles.size() == 20001;
+    }
+    cout << " " << ((threads > 0) ? to_string(threads) + " threads" : string("serial")) << ": "
+         << s << " steps, " << g.sites.size() << " cells + " << g.particles.size() << " walkers, "
+         << (conserved ? "mass conserved" : "MASS LOST") << "\n";
+    return conserved;
+}
+
+int mass(int steps) {
+    cout << "\n" << steps << " steps, 1024 x 1024, 20000 particles, long jumps\n";
+    bool serial = conservesMass(0, steps);
+    bool parallel = conservesMass(2, steps);
+    return (serial && parallel) ? 0 : -1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "offlattice") return offLattice((argc > 2) ? atoi(argv[2]) : 1000000);
+    if (argc > 1 && string(argv[1]) == "mass") return mass((argc > 2) ? atoi(argv[2]) : 50000);
+    if (argc > 1 && string(argv[1]) == "scaling") return scaling((argc > 2) ? atoi(argv[2]) : 200);
+    if (argc > 1 && string(argv[1]) == "output") return output((argc > 2) ? atoi(argv[2]) : 200000);
+    if (argc > 1 && string(argv[1]) == "sparse") return sparse((argc > 2) ? atoi(argv[2]) : 200000);
+    if (argc > 1 && string(argv[1]) == "fractal") return fractal((argc > 2) ? atoi(argv[2]) : 200000);
+    int steps = (argc > 1) ? atoi(argv[1]) : 2000;
+
+    LegacyGrid legacy(1024, 1024, 20000);
+    double walkerSteps = 0;
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) {
+        walkerSteps += legacy.particles.size();
+        legacy.updateParticles();
+    }
+    double legacySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double legacyRate = walkerSteps/legacySeconds;
+
+    Grid g(1024, 1024, 20000, 1);
+    walkerSteps = 0;
+    start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) {
+        walkerSteps += g.particles.size();
+        g.updateParticles();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double rate = walkerSteps/seconds;
+
+    cout << "\n" << steps << " steps, 1024 x 1024, 20000 particles\n";
+    cout << " original (list) : " << legacyRate/1e6 << " M walker-steps/s\n";
+    cout << " Grid            : " << rate/1e6 << " M walker-steps/s (x" << rate/legacyRate << ")\n";
+    return 0;
+}
@@ -1,151 +1,123 @@
+//Diffusion limited aggregation
+//compilation: g++ -O3 -std=c++11 -pthread -o dla main.cpp
+//make sure to keep DLA.h, OffLattice.h, Bitmap.h, Fractal.h and Output.h in the same folder as main.cpp,
+//and ../Common/Random.h, ThreadPool.h, AsyncWriter.h and Profiler.h
+
 #include <iostream>
-#include <fstream>
 #include <string>
-#include <vector>
-#include <list>
-#include <iterator>
-#include <random>
-#include <cmath>
 #include <ctime>
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <memory>
 
-using namespace std;
+#include "DLA.h"
+#include "OffLattice.h"
 
-//random devices
-random_device rd;
-mt19937 gen(rd());
+using namespace std;
 
-//modulus function 
-//different from simply remainder, denoted by "%"
-//we want, for example, mod(-1, 10) to be 9 and not -1
-//so that we can access indices of grid periodically
-int mod(int x, int N) {
-    return (x % N + N) % N;
-}
+//periodic snapshots of the aggregate, encoded and written by a background thread
+//snapshot k is saved to "<stem>_<k><extension>", for the stem and extension of filename
+//the writer (and its thread) is only started by the first snapshot
+struct Snapshots {
+    int every = 0;
+    string filename;
+    int count = 0;
+    unique_ptr<AsyncWriter> writer;
 
-class Particle {
-    public:
-        int y;
-        int x;
-        Particle(int Y, int X) {
-            y = Y;
-            x = X;
-        }
-        ~Particle() {}
+    template <class Lattice>
+    void take(Aggregate<Lattice> &a) {
+        if (!writer) writer.reset(new AsyncWriter());
+        size_t dot = filename.rfind('.');
+        if (dot == string::npos) dot = filename.size();
+        char number[16];
+        snprintf(number, sizeof(number), "_%06d", ++count);
+        a.snapshot(*writer, filename.substr(0, dot) + number + filename.substr(dot));
+    }
 };
 
-class Grid {
-
-    public:
-        int W;
-        int H;
-        int maxParticles;
-        int stp = 0;
-        list<Particle> particles;
-        vector<vector<int>> aggregate; //points given as (y, x)
-        
-        Grid(int h, int w, int N) {
-            //height and width of grid
-            W = w;
-            H = h;
-            maxParticles = N;
-            cout << "Grid size: " << W << " x " << H << " = " << W*H << " cells\n";
-            //populate the grid
-            uniform_int_distribution<> distribY(0, H-1);
-            uniform_int_distribution<> distribX(0, W-1);
-            for (int i = 0; i < N; i++) {
-                particles.push_back(Particle(distribY(gen), distribX(gen)));
-            }
-            cout << "Created: " << particles.size() << " particles\n";
-            
-            //make agreggate
-            for (int i = 0; i < H; i++) {
-                vector<int> a;
-                aggregate.push_back(a);
-                for (int j = 0; j < W; j++) {
-                    aggregate[i].push_back(0);
-                }
-            }
-            //place seed
-            aggregate[H/2][W/2] = 1;
-            cout << "Placed seed at: " << H/2 << ", " << W/2 << "\n";
+//updates the grid until updateParticles() says it's done, or maxSteps is reached
+//printing some information on the current state of the simulation
+void grow(Grid &g, int maxSteps, Snapshots &snapshots, Profiler &profiler) {
+    int io = profiler.phase("io");
+    bool update = true;
+    while (g.stp < maxSteps && update) {
+        update = g.updateParticles();
+        if (snapshots.every > 0 && g.stp % snapshots.every == 0) {
+            Profiler::Timer timer(&profiler, io);
+            snapshots.take(g);
         }
-
-        bool updateParticles() {
-            //if there are less than 5% of particles left, we exit (takes too long if not)
-            if ( (double)(particles.size())/maxParticles < 0.05) {
-                cout << "\n5% of particles left. Updating done...\n";
-                return false;
-            }
-            for (auto i = particles.begin(); i != particles.end(); ) {
-                if (fixedNear(i->y, i->x)) {
-                    aggregate[i->y][i->x] = 1+stp;
-                    i = particles.erase(i);
-                }
-                else {
-                    switch(uniform_int_distribution<int>{0, 3}(gen)) {
-                        case 0:
-                            i->y -= 1;
-                            break;
-                        case 1:
-                            i->x += 1;
-                            break;
-                        case 2:
-                            i->y += 1;
-                            break;
-                        case 3:
-                            i->x -= 1;
-                            break;
-                    }
-                    i->y = mod(i->y, H);
-                    i->x = mod(i->x, W);
-                    i++;
-                }
-            }
-            stp++;
-            return true;
+        if (profiler.due()) {
+            //the run ends at maxSteps, or when 5% of the particles are left
+            double fraction = max((double)g.stp/maxSteps, (1 - (double)g.particles.size()/g.maxParticles)/0.95);
+            profiler.progress(g.stp, fraction, "Iteration: " + to_string(g.stp) + " (max: " + to_string(maxSteps)
+                              + ") | Particles: " + to_string(g.particles.size()));
         }
+    }
+    profiler.steps = g.stp;
+}
 
-        //save the agreggate to file
-        void saveToFile(string filename = "out_default.csv") {
-            fstream file;
-            file.open(filename, fstream::out);
-            if (!file.is_open()) {
-                cout << "\nCouldn't open file: " << filename << "\n";
-                return;
-            }
-            cout << "\nSaving current aggregate to: " << filename << endl;
-            for (int y = 0; y < H; y++) {
-                for (int x = 0; x < W; x++) {
-                    if (aggregate[y][x] >= 1 ) file << x << " " << y << " " << aggregate[y][x] << "\n";
-                }
-            }
-            file.close();
-            cout << "Saving done\n";
+//adds particles to the cluster one at a time until it has n cells, or fills its lattice
+//(for Cluster and OffLatticeCluster). a step is one particle, and its moves the items
+template <class C>
+void grow(C &c, int n, Snapshots &snapshots, Profiler &profiler) {
+    int move = profiler.phase("move");
+    int io = profiler.phase("io");
+    bool added = true;
+    while ((int)c.sites.size() < n && added) {
+        {
+            Profiler::Timer timer(&profiler, move);
+            long long moves = c.moves;
+            added = c.addParticle();
+            timer.addItems(c.moves - moves);
         }
+        if (snapshots.every > 0 && c.sites.size() % snapshots.every == 0) {
+            Profiler::Timer timer(&profiler, io);
+            snapshots.take(c);
+        }
+        if (profiler.due()) {
+            char label[128];
+            snprintf(label, sizeof(label), "Particles: %d (max: %d) | R_max: %g | Rg: %g",
+                     (int)c.sites.size(), n, c.R_max, c.Rg());
+            profiler.progress(c.sites.size(), (double)c.sites.size()/n, label);
+        }
+    }
+    profiler.steps = c.sites.size();
+}
 
-        ~Grid() {}
-
-    private:
+//fractal dimension of the aggregate, measured in three ways (see Fractal.h)
+template <class Lattice>
+void printDimensions(Aggregate<Lattice> &a, Profiler &profiler) {
+    Profiler::Timer timer(&profiler, profiler.phase("analysis"));
+    cout << "Fractal dimension:\n";
+    cout << " box counting (boxes of 2 to 64): " << a.fractalDimension() << "\n";
+    cout << " mass-radius:                     " << a.massRadiusDimension() << "\n";
+    cout << " radius of gyration:              " << a.gyrationDimension() << "\n";
+}
 
-        //checks 8 neighbouring cells
-        bool fixedNear(int y, int x) {
-            for (int i = -1; i <= 1; i++) {
-                for (int j = -1; j <= 1; j++) {
-                    if (aggregate[mod(y+i, H)][mod(x+j, W)] >= 1) return true;
-                }
-            }
-            return false;
-        }
-};
+//smallest power of two lattice whose kill circle holds a cluster of n cells, from
+//R_max ~ 1.3 n^(1/1.71) on the lattice (~ 1.45 n^(1/1.71) off it), with some margin
+int latticeFor(int n, double prefactor = 1.5) {
+    double R = prefactor*pow((double)n, 1/1.71);
+    int size = 256;
+    while (size/2 < 1.5*(R + 5) + 12) size *= 2;
+    return size;
+}
 
 int main(int argc, char** argv) {
 
-    //seed random with current time
-    gen.seed(time(NULL));
+    //seed random with current time, unless a seed is given by passing "-seed <n>"
+    //(the same seed always grows the same aggregate)
+    unsigned long seed = time(NULL);
+    for (int i = 1; i+1 < argc; i++) {
+        if (string(argv[i]) == "-seed") seed = strtoul(argv[i+1], NULL, 10);
+    }
+    cout << "Seed: " << seed << endl;
 
     //check if user has passed a filename to save agreggate to
     //this is passed by passing "-f <filename>"
     //by default, the agreggate is saved to "out_default.csv"
+    //the extension picks the format: ".bin", ".rle", ".pgm", ".ppm" or text (see Output.h)
     //be careful not to overwrite a previous agreggate like this
     bool customSaveFile = false;
     string filename;
@@ -158,30 +130,137 @@ int main(int argc, char** argv) {
         }
     }
     if (customSaveFile == false) cout << "No filename given. Will save to default: out_default.csv" << endl; 
-    
-    //create a grid
-    Grid g(1024, 1024, 20000);
-    
+
+    //"-jump" turns on the accelerated (long jump) walks
+    //"-validate" grows the same aggregate with plain and accelerated walks and compares
+    //their box counting dimensions, without saving anything
+    bool jump = false;
+    bool validate = false;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "-jump") jump = true;
+        if (string(argv[i]) == "-validate") validate = true;
+    }
+
+    //"-threads <n>" moves the particles on n threads (see Grid::setThreads)
+    //the aggregate then depends on the seed only, not on n
+    int threads = 0;
+    for (int i = 1; i+1 < argc; i++) {
+        if (string(argv[i]) == "-threads") threads = atoi(argv[i+1]);
+    }
+
+    //"-snapshot <n>" saves the aggregate every n steps (or every n cells with -single), to
+    //numbered files named after the save file, in its format. e.g. "-f out.pgm -snapshot
+    //1000" writes out_000001.pgm, out_000002.pgm, ...
+    Snapshots snapshots;
+    snapshots.filename = customSaveFile ? filename : "out_default.csv";
+    for (int i = 1; i+1 < argc; i++) {
+        if (string(argv[i]) == "-snapshot") snapshots.every = atoi(argv[i+1]);
+    }
+    Snapshots noSnapshots;
+
+    //"-profile <file>" writes the time spent in each phase of the run to file, as JSON
+    //(see Common/Profiler.h). a summary is printed at the end of every run
+    Profiler profiler("dla");
+    for (int i = 1; i+1 < argc; i++) {
+        if (string(argv[i]) == "-profile") profiler.dumpFilename = argv[i+1];
+    }
+
+    //"-single <n>" grows a cluster of n cells one walker at a time (see Cluster in DLA.h)
+    //instead of filling the grid with particles. "-size <L>" sets the side of its lattice,
+    //by default the smallest power of two that fits n cells
+    //"-offlattice <n>" does the same with n disks at continuous positions (see
+    //OffLattice.h). the text format then has their exact centers, the others their cells
+    int single = 0;
+    int offLattice = 0;
+    int size = 0;
+    for (int i = 1; i+1 < argc; i++) {
+        if (string(argv[i]) == "-single") single = atoi(argv[i+1]);
+        if (string(argv[i]) == "-offlattice") offLattice = atoi(argv[i+1]);
+        if (string(argv[i]) == "-size") size = atoi(argv[i+1]);
+    }
+
+    if (offLattice > 0) {
+        if (size <= 0) size = latticeFor(offLattice, 2.0);
+        OffLatticeCluster c(size, seed);
+        cout << "Lattice size: " << size << " x " << size << "\n";
+        cout << "Starting off lattice simulation...\n\n";
+        time_t start = time(NULL);
+        grow(c, offLattice, snapshots, profiler);
+        cout << "\nTook " << difftime(time(NULL), start) << " s, " << c.moves << " moves\n";
+        cout << "Disks: " << c.sites.size() << " | R_max: " << c.R_max << " | Rg: " << c.Rg()
+             << " | Memory: " << c.bytes()/1048576.0 << " MB\n";
+        printDimensions(c, profiler);
+        string out = customSaveFile ? filename : "out_default.csv";
+        {
+            Profiler::Timer timer(&profiler, profiler.phase("io"));
+            if (isTextFormat(out)) c.savePositions(out);
+            else c.saveToFile(out);
+        }
+        profiler.summary();
+        cout << "Exiting...\n\n";
+        return 0;
+    }
+
+    if (single > 0) {
+        if (size <= 0) size = latticeFor(single);
+        Cluster c(size, seed);
+        cout << "Lattice size: " << size << " x " << size << "\n";
+        if (jump) c.enableLongJumps();
+        cout << "Starting single walker simulation...\n\n";
+        time_t start = time(NULL);
+        grow(c, single, snapshots, profiler);
+        cout << "\nTook " << difftime(time(NULL), start) << " s, " << c.moves << " moves\n";
+        cout << "Cells: " << c.sites.size() << " | R_max: " << c.R_max << " | Rg: " << c.Rg()
+             << " | Memory: " << c.bytes()/1048576.0 << " MB\n";
+        printDimensions(c, profiler);
+        {
+            Profiler::Timer timer(&profiler, profiler.phase("io"));
+            if (customSaveFile) c.saveToFile(filename);
+            else c.saveToFile();
+        }
+        profiler.summary();
+        cout << "Exiting...\n\n";
+        return 0;
+    }
+
     //maxSteps guarantees exiting after this many iterations
     int maxSteps = 3000000;
-    bool update = true;
-    
-    //in this loop we update and print some information on the current state of the simulation
+
+    if (validate) {
+        Grid plain(1024, 1024, 20000, seed);
+        Grid accelerated(1024, 1024, 20000, seed);
+        accelerated.enableLongJumps();
+        cout << "Starting plain walk simulation...\n\n";
+        time_t start = time(NULL);
+        grow(plain, maxSteps, noSnapshots, profiler);
+        cout << "Took " << difftime(time(NULL), start) << " s\n";
+        cout << "Starting long jump simulation...\n\n";
+        start = time(NULL);
+        grow(accelerated, maxSteps, noSnapshots, profiler);
+        cout << "Took " << difftime(time(NULL), start) << " s\n";
+        cout << "\nBox counting dimension (box sizes 2 to 64):\n";
+        cout << " plain walks: " << plain.fractalDimension() << " (" << plain.sites.size() << " cells)\n";
+        cout << " long jumps:  " << accelerated.fractalDimension() << " (" << accelerated.sites.size() << " cells)\n";
+        return 0;
+    }
+
+    //create a grid
+    Grid g(1024, 1024, 20000, seed);
+    if (jump) g.enableLongJumps();
+    if (threads > 0) g.setThreads(threads);
+    g.setProfiler(&profiler);
+
     cout << "Starting simulation...\n\n";
-    while (g.stp < maxSteps) {
-        if (update == true) {
-            update = g.updateParticles();
-            if (g.stp % 50 == 0) {    
-                cout << "\rIteration: " << g.stp << " (max: " << maxSteps << ") | Particles: " << g.particles.size() << flush;
-            }
-        }
-        //if updating is done, save to file and exit
-        else {
-            if (customSaveFile) g.saveToFile(filename);
-            else g.saveToFile();
-            cout << "Exiting...\n\n";
-            break;
-        }
+    grow(g, maxSteps, snapshots, profiler);
+    //when updating is done, save to file and exit
+    cout << "\n";
+    printDimensions(g, profiler);
+    {
+        Profiler::Timer timer(&profiler, profiler.phase("io"));
+        if (customSaveFile) g.saveToFile(filename);
+        else g.saveToFile();
     }
+    profiler.summary();
+    cout << "Exiting...\n\n";
     return 0;
 }
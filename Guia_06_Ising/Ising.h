@@ -0,0 +1,388 @@
+//Ising Model simulator on periodic lattices
+//shared by ising_final.cpp (single run) and sweep.cpp (batch temperature sweeps)
+//
+//the engine is a template on the lattice geometry, which fixes at compile time the
+//dimension and the neighbours of every site. this lets the compiler unroll the
+//neighbour sums and size the acceptance tables statically, so the generic engine
+//runs as fast as a hand written kernel for each lattice (see bench.cpp)
+//
+//  H = -J sum_<ij> s_i s_j - h sum_i s_i
+
+#ifndef ISING_H
+#define ISING_H
+
+#include <vector>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+#include "Observables.h"
+#include "../Common/Random.h"
+
+//lattice geometries. each one gives its dimension, its number of neighbours z,
+//and offset(k, d): the step along axis d that leads to neighbour k
+
+//square (D = 2), simple cubic (D = 3), ... lattices with 2D nearest neighbours
+template <int D>
+struct Hypercubic {
+    static const int dim = D;
+    static const int z = 2*D;
+    static constexpr int offset(int k, int d) {
+        return (k/2 == d) ? ((k%2) ? 1 : -1) : 0;
+    }
+};
+
+//triangular lattice stored on a square grid: the 4 square neighbours
+//plus the (y-1, x+1) and (y+1, x-1) diagonals
+struct Triangular {
+    static const int dim = 2;
+    static const int z = 6;
+    static constexpr int offset(int k, int d) {
+        return (d == 0) ? ((k == 0 || k == 4) ? -1 : ((k == 1 || k == 5) ? 1 : 0))
+                        : ((k == 2 || k == 5) ? -1 : ((k == 3 || k == 4) ? 1 : 0));
+    }
+};
+
+template <class Geometry>
+class IsingModel {
+    public:
+        static const int D = Geometry::dim;
+        static const int z = Geometry::z;
+        //N will be the lattice side length in number of cells, so there are N^D spins
+        int N;
+        long long volume;
+        double T;
+        double J = 1.0; //coupling
+        double h = 0.0; //external field
+        double E_tot = 0.0;
+        double M_tot = 0.0;
+        long long steps = 0; //attempted flips since the lattice was created
+        //spins stored row major, axis 0 being the slowest one (for D = 2: index = y*N + x)
+        std::vector<int8_t> spins;
+        //each lattice owns its random generator, so that several lattices
+        //can be simulated at the same time on different threads
+        Random rng;
+        //running averages of everything measured so far at temperature T
+        Observables obs;
+
+        IsingModel(int N_, double T_) : IsingModel(N_, T_, std::chrono::high_resolution_clock::now().time_since_epoch().count()) {}
+
+        IsingModel(int N_, double T_, unsigned long seed, double J_ = 1.0, double h_ = 0.0) {
+            //seed random generator
+            rng.seed(seed);
+            T = T_;
+            J = J_;
+            h = h_;
+            resize(N_);
+            obs = Observables(volume, T);
+            setAcceptance();
+            //initialilze lattice by filling it with spins
+            for (long long i = 0; i < volume; i++) {
+                spins[i] = 2*(int)(rng.next() >> 63)-1; //this writes a -1 or a 1
+            }
+            computeTotals();
+        }
+
+        //restores a lattice saved with save(). on failure an error is printed and N is left as 0
+        IsingModel(std::string filename) {
+            N = 0;
+            volume = 0;
+            T = 0;
+            load(filename);
+        }
+
+        //update the lattice, and the total energy and magnetization
+        //every attempted flip uses exactly two random words: one for the point, one for
+        //the acceptance test. so sweep() gives the same result as N^D calls to updateGrid()
+        void updateGrid() {
+            uint64_t site = rng.next();
+            uint64_t coin = rng.next();
+            tryFlip(site, coin);
+            steps++;
+        }
+
+        //one time unit (a Monte Carlo sweep): N^D attempted flips
+        //the random words are drawn in bulk, a chunk at a time
+        void sweep() {
+            const int chunk = 2048;
+            uint64_t bits[2*chunk];
+            for (long long done = 0; done < volume; done += chunk) {
+                int n = (int)std::min((long long)chunk, volume - done);
+                rng.fillBits(bits, 2*n);
+                for (int k = 0; k < n; k++) tryFlip(bits[2*k], bits[2*k+1]);
+            }
+            steps += volume;
+        }
+
+        //time units (sweeps) simulated so far
+        long long sweeps() {
+            return steps/volume;
+        }
+
+        //change the temperature keeping the current spins. used to warm start
+        //a run from a lattice already equilibrated at a nearby temperature
+        //the averages accumulated at the old temperature are discarded
+        void setTemperature(double T_) {
+            T = T_;
+            obs = Observables(volume, T);
+            setAcceptance();
+        }
+
+        //change the coupling and field keeping the current spins. like setTemperature(),
+        //this discards the averages accumulated so far
+        void setCouplings(double J_, double h_) {
+            J = J_;
+            h = h_;
+            computeTotals();
+            setTemperature(T);
+        }
+
+        //add the current state as one sample to the running averages
+        void measure() {
+            obs.push(E_per_spin(), M_per_spin());
+        }
+
+        double E_per_spin() {
+            return E_tot/volume;
+        }
+        double M_per_spin() {
+            return M_tot/volume;
+        }
+
+        //spin at the given coordinates (axis 0 first)
+        int spin(const int *c) {
+            long long i = 0;
+            for (int d = 0; d < D; d++) i = i*N + c[d];
+            return spins[i];
+        }
+
+        //checkpoints. a snapshot holds everything needed to continue the run exactly as
+        //if it had never stopped. binary format (native byte order):
+        //  "ISNG", int32 version (2), int32 D, int32 z, int32 N, double T, J, h, E_tot, M_tot,
+        //  int64 steps, uint64 rng.s[4][4], int32 rng.lane,
+        //  uint64 spins[(N^D+63)/64] (bit set = spin up, row major), then the state of obs
+        //version 1 snapshots (square lattice with J = 1, h = 0, and no D, z, J, h fields)
+        //can still be loaded
+        //the snapshot is written to "<filename>.tmp" and renamed, so killing the program
+        //while saving never destroys the previous checkpoint
+        bool save(std::string filename) {
+            std::string tmpFilename = filename + ".tmp";
+            std::ofstream file(tmpFilename, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!file.is_open()) {
+                std::cout << "Couldn't open file: " << tmpFilename << "\n";
+                return false;
+            }
+            int32_t header[4] = {2, D, z, N};
+            int64_t steps64 = steps;
+            int32_t lane = rng.lane;
+            file.write("ISNG", 4);
+            file.write((char*)header, sizeof(header));
+            file.write((char*)&T, sizeof(T));
+            file.write((char*)&J, sizeof(J));
+            file.write((char*)&h, sizeof(h));
+            file.write((char*)&E_tot, sizeof(E_tot));
+            file.write((char*)&M_tot, sizeof(M_tot));
+            file.write((char*)&steps64, sizeof(steps64));
+            file.write((char*)rng.s, sizeof(rng.s));
+            file.write((char*)&lane, sizeof(lane));
+            std::vector<uint64_t> packed((volume + 63)/64, 0);
+            for (long long i = 0; i < volume; i++) {
+                if (spins[i] > 0) packed[i/64] |= 1ULL << (i%64);
+            }
+            file.write((char*)packed.data(), packed.size()*sizeof(uint64_t));
+            obs.write(file);
+            file.close();
+            if (!file || std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+                std::cout << "Couldn't write checkpoint: " << filename << "\n";
+                return false;
+            }
+            return true;
+        }
+
+        //replaces the state of this lattice by the one saved in filename
+        bool load(std::string filename) {
+            std::ifstream file(filename, std::ios::in | std::ios::binary);
+            if (!file.is_open()) {
+                std::cout << "Error opening file: " << filename << "\n";
+                return false;
+            }
+            char magic[4];
+            int32_t version, D32 = 2, z32 = 4, N32, lane;
+            int64_t steps64;
+            double T_, J_ = 1.0, h_ = 0.0, E_, M_;
+            file.read(magic, 4);
+            file.read((char*)&version, sizeof(version));
+            if (!file || std::string(magic, 4) != "ISNG" || (version != 1 && version != 2)) {
+                std::cout << "Not an Ising checkpoint: " << filename << "\n";
+                return false;
+            }
+            if (version >= 2) {
+                file.read((char*)&D32, sizeof(D32));
+                file.read((char*)&z32, sizeof(z32));
+            }
+            file.read((char*)&N32, sizeof(N32));
+            file.read((char*)&T_, sizeof(T_));
+            if (version >= 2) {
+                file.read((char*)&J_, sizeof(J_));
+                file.read((char*)&h_, sizeof(h_));
+            }
+            file.read((char*)&E_, sizeof(E_));
+            file.read((char*)&M_, sizeof(M_));
+            file.read((char*)&steps64, sizeof(steps64));
+            Random rng_;
+            file.read((char*)rng_.s, sizeof(rng_.s));
+            file.read((char*)&lane, sizeof(lane));
+            rng_.lane = lane;
+            //the spins must fit in the rest of the file, which bounds N^D before anything
+            //is allocated (checked an axis at a time, so that it can't overflow)
+            std::streampos here = file.tellg();
+            file.seekg(0, std::ios::end);
+            long long bits = 8*(long long)(file.tellg() - here);
+            file.seekg(here);
+            if (!file || N32 <= 0) {
+                std::cout << "Corrupted checkpoint: " << filename << "\n";
+                return false;
+            }
+            if (D32 != D || z32 != z) {
+                std::cout << "Checkpoint " << filename << " is for a lattice with D = " << D32
+                          << ", z = " << z32 << ", not D = " << D << ", z = " << z << "\n";
+                return false;
+            }
+            long long volume_ = 1;
+            for (int d = 0; d < D; d++) {
+                if (volume_ > bits/N32) {
+                    std::cout << "Corrupted checkpoint: " << filename << "\n";
+                    return false;
+                }
+                volume_ *= N32;
+            }
+            std::vector<uint64_t> packed((volume_ + 63)/64);
+            file.read((char*)packed.data(), packed.size()*sizeof(uint64_t));
+            Observables obs_;
+            if (!file || !obs_.read(file)) {
+                std::cout << "Corrupted checkpoint: " << filename << "\n";
+                return false;
+            }
+            resize(N32);
+            T = T_;
+            J = J_;
+            h = h_;
+            E_tot = E_;
+            M_tot = M_;
+            steps = steps64;
+            rng = rng_;
+            obs = obs_;
+            for (long long i = 0; i < volume; i++) {
+                spins[i] = (packed[i/64] >> (i%64)) & 1 ? 1 : -1;
+            }
+            setAcceptance();
+            return true;
+        }
+
+        ~IsingModel() {}
+
+    private:
+        //distance in memory between neighbours along each axis
+        long long stride[D];
+        //acceptance[(s+1)/2][(sum+z)/2] is the Boltzmann factor min(1, exp(-dE/T)) of
+        //flipping spin s when its neighbours add up to sum, scaled to 2^64 so that it can
+        //be compared directly to a random word
+        uint64_t acceptance[2][z+1];
+
+        void resize(int N_) {
+            N = N_;
+            volume = 1;
+            for (int d = D-1; d >= 0; d--) {
+                stride[d] = volume;
+                volume *= N;
+            }
+            spins.assign(volume, 1);
+        }
+
+        void setAcceptance() {
+            for (int s = 0; s < 2; s++) {
+                for (int k = 0; k <= z; k++) {
+                    double p = exp(-flipEnergy(2*s-1, 2*k-z)/T);
+                    acceptance[s][k] = (p >= 1.0) ? UINT64_MAX : (uint64_t)ldexp(p, 64);
+                }
+            }
+        }
+
+        //energy and magnetization from scratch (the bond sum counts every bond twice)
+        void computeTotals() {
+            E_tot = 0.0;
+            M_tot = 0.0;
+            int c[D];
+            for (long long i = 0; i < volume; i++) {
+                long long r = i;
+                for (int d = D-1; d >= 0; d--) {
+                    c[d] = r % N;
+                    r /= N;
+                }
+                E_tot += -0.5*J*spins[i]*neighbourSum(i, c) - h*spins[i];
+                M_tot += spins[i];
+            }
+        }
+
+        //energy required to flip spin s when its neighbours add up to sum
+        double flipEnergy(int s, int sum) {
+            return 2*s*(J*sum + h); //E' - E, with s -> -s
+        }
+
+        //sum of the neighbours of the spin at index i, with coordinates c
+        //the loops have compile time bounds and offsets, so they are fully unrolled
+        //and only the wrap around of the axes that actually move is tested
+        int neighbourSum(long long i, const int *c) {
+            int sum = 0;
+            for (int k = 0; k < z; k++) {
+                long long j = i;
+                for (int d = 0; d < D; d++) {
+                    int o = Geometry::offset(k, d);
+                    if (o == 1) j += (c[d] == N-1) ? -(N-1)*stride[d] : stride[d];
+                    else if (o == -1) j += (c[d] == 0) ? (N-1)*stride[d] : -stride[d];
+                }
+                sum += spins[j];
+            }
+            return sum;
+        }
+
+        //attempts to flip the spin picked by the random word site, accepting with the random
+        //word coin. the site word is split in D fields of 64/D bits, one per coordinate
+        //(for D = 2: y from its top 32 bits, x from its bottom 32 bits). each field is
+        //mapped to [0, N) by a multiply and shift, using at most 32 bits of it, which picks
+        //some sites with a probability higher by at most a factor 1 + N/2^b, with b the bits
+        //used (1 + N/2^32 for D = 2, 1 + N/2^21 for D = 3). every single site update still
+        //satisfies detailed balance, so this does not bias the equilibrium averages
+        void tryFlip(uint64_t site, uint64_t coin) {
+            const int width = 64/D;
+            const int bits = (width > 32) ? 32 : width;
+            const uint64_t mask = (1ULL << bits) - 1;
+            int c[D];
+            long long i = 0;
+            for (int d = 0; d < D; d++) {
+                uint64_t field = (site >> (64 - width*(d+1))) & mask;
+                c[d] = (int)((field * N) >> bits);
+                i += c[d]*stride[d];
+            }
+            int s = spins[i];
+            int sum = neighbourSum(i, c);
+            //check if flip is accepted, and if so, update lattice, E and M
+            if (coin < acceptance[(s+1)/2][(sum+z)/2]) {
+                spins[i] = -s;
+                E_tot += flipEnergy(s, sum);
+                M_tot -= 2*s;
+            }
+        }
+};
+
+//the lattices used by the programs in this folder
+typedef IsingModel<Hypercubic<2>> Grid;
+typedef IsingModel<Hypercubic<3>> CubicGrid;
+typedef IsingModel<Triangular> TriangularGrid;
+
+#endif
@@ -0,0 +1,249 @@
+//Streaming accumulators for the Ising model observables
+//samples are never stored: means, variances, autocorrelation times and error
+//bars are all updated online, using O(log n) memory (Flyvbjerg-Petersen blocking)
+
+#ifndef OBSERVABLES_H
+#define OBSERVABLES_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+
+//running blocking analysis of a single time series
+//level k holds statistics of the series averaged over blocks of 2^k samples.
+//for correlated data the naive error of the mean grows with k until the blocks
+//are longer than the autocorrelation time, and then plateaus at the true error
+class Blocking {
+    public:
+        //minimum number of blocks a level needs to be trusted
+        static const int minBlocks = 64;
+
+        void push(double x) {
+            for (size_t k = 0; ; k++) {
+                if (k == levels.size()) levels.push_back(Level());
+                Level &l = levels[k];
+                l.n++;
+                l.sum += x;
+                l.sum2 += x*x;
+                if (k == 0) {
+                    if (l.n == 1) first = x;
+                    else lag1 += x*last;
+                    last = x;
+                }
+                //the first sample of a pair waits, the second one is averaged with it
+                //and passed on to the next level
+                if (!l.hasPending) {
+                    l.pending = x;
+                    l.hasPending = true;
+                    return;
+                }
+                x = 0.5*(x + l.pending);
+                l.hasPending = false;
+            }
+        }
+
+        long count() {
+            return levels.empty() ? 0 : levels[0].n;
+        }
+
+        double mean() {
+            return levels.empty() ? 0.0 : levels[0].sum/levels[0].n;
+        }
+
+        //variance of the samples themselves
+        double variance() {
+            return levelVariance(0);
+        }
+
+        //naive error of the mean, as if samples were uncorrelated
+        double naiveError() {
+            return levelError(0);
+        }
+
+        //error of the mean, taken as the largest error among the levels that
+        //still have at least minBlocks blocks (a conservative plateau estimate)
+        double error() {
+            double err = naiveError();
+            for (size_t k = 1; k < levels.size(); k++) {
+                if (levels[k].n < minBlocks) break;
+                err = std::max(err, levelError(k));
+            }
+            return err;
+        }
+
+        //integrated autocorrelation time in units of samples, from
+        //error^2 = 2*tau*variance/n
+        double tau() {
+            double naive = naiveError();
+            if (naive == 0) return 0.5;
+            double r = error()/naive;
+            return 0.5*r*r;
+        }
+
+        //normalized autocorrelation between consecutive samples
+        double lag1Correlation() {
+            long n = count();
+            double var = variance();
+            if (n < 2 || var == 0) return 0.0;
+            double m = mean();
+            //sum over pairs of (x_i - m)(x_{i+1} - m), from the raw sums
+            double sumHead = levels[0].sum - last;  //x_1 ... x_{n-1}
+            double sumTail = levels[0].sum - first; //x_2 ... x_n
+            double cov = (lag1 - m*(sumHead + sumTail) + (n-1)*m*m)/(n-1);
+            return cov/var;
+        }
+
+        void reset() {
+            levels.clear();
+            lag1 = 0.0;
+            last = 0.0;
+            first = 0.0;
+        }
+
+        //binary (de)serialization of the full state, used by the Grid checkpoints
+        void write(std::ostream &out) {
+            int32_t nLevels = levels.size();
+            out.write((char*)&nLevels, sizeof(nLevels));
+            for (int k = 0; k < nLevels; k++) {
+                int64_t n = levels[k].n;
+                uint8_t hasPending = levels[k].hasPending;
+                out.write((char*)&n, sizeof(n));
+                out.write((char*)&levels[k].sum, sizeof(double));
+                out.write((char*)&levels[k].sum2, sizeof(double));
+                out.write((char*)&levels[k].pending, sizeof(double));
+                out.write((char*)&hasPending, sizeof(hasPending));
+            }
+            out.write((char*)&lag1, sizeof(double));
+            out.write((char*)&first, sizeof(double));
+            out.write((char*)&last, sizeof(double));
+        }
+
+        bool read(std::istream &in) {
+            int32_t nLevels = 0;
+            in.read((char*)&nLevels, sizeof(nLevels));
+            if (!in || nLevels < 0 || nLevels > 64) return false;
+            levels.assign(nLevels, Level());
+            for (int k = 0; k < nLevels; k++) {
+                int64_t n;
+                uint8_t hasPending;
+                in.read((char*)&n, sizeof(n));
+                in.read((char*)&levels[k].sum, sizeof(double));
+                in.read((char*)&levels[k].sum2, sizeof(double));
+                in.read((char*)&levels[k].pending, sizeof(double));
+                in.read((char*)&hasPending, sizeof(hasPending));
+                levels[k].n = n;
+                levels[k].hasPending = hasPending;
+            }
+            in.read((char*)&lag1, sizeof(double));
+            in.read((char*)&first, sizeof(double));
+            in.read((char*)&last, sizeof(double));
+            return (bool)in;
+        }
+
+    private:
+        struct Level {
+            long n = 0;
+            double sum = 0.0;
+            double sum2 = 0.0;
+            double pending = 0.0;
+            bool hasPending = false;
+        };
+        std::vector<Level> levels;
+        double lag1 = 0.0;  //sum of x_i*x_{i+1}
+        double first = 0.0; //first sample pushed
+        double last = 0.0;  //last sample pushed
+
+        double levelVariance(int k) {
+            if (k >= (int)levels.size() || levels[k].n < 2) return 0.0;
+            double m = levels[k].sum/levels[k].n;
+            return std::max(0.0, (levels[k].sum2/levels[k].n - m*m)*levels[k].n/(levels[k].n - 1));
+        }
+
+        double levelError(int k) {
+            if (k >= (int)levels.size() || levels[k].n < 2) return 0.0;
+            return sqrt(levelVariance(k)/levels[k].n);
+        }
+};
+
+//accumulates the thermodynamic averages of an Ising lattice at temperature T
+//one sample is pushed per measurement with the energy and magnetization per spin
+class Observables {
+    public:
+        double spins; //number of spins
+        double T;
+
+        Observables(double spins_ = 1, double T_ = 1) {
+            spins = spins_;
+            T = T_;
+        }
+
+        void push(double e, double m) {
+            double am = fabs(m);
+            E.push(e);
+            E2.push(e*e);
+            absM.push(am);
+            M2.push(m*m);
+            M4.push(m*m*m*m);
+        }
+
+        long count() {
+            return E.count();
+        }
+
+        double meanE() { return E.mean(); }
+        double errorE() { return E.error(); }
+        double tauE() { return E.tau(); }
+
+        double meanAbsM() { return absM.mean(); }
+        double errorAbsM() { return absM.error(); }
+        double tauAbsM() { return absM.tau(); }
+
+        //specific heat per spin: spins*(<e^2> - <e>^2) / T^2
+        double C() {
+            double e = E.mean();
+            return spins*(E2.mean() - e*e)/(T*T);
+        }
+
+        //susceptibility per spin: spins*(<m^2> - <|m|>^2) / T
+        double chi() {
+            double m = absM.mean();
+            return spins*(M2.mean() - m*m)/T;
+        }
+
+        //Binder cumulant: 1 - <m^4> / (3 <m^2>^2)
+        double binder() {
+            double m2 = M2.mean();
+            if (m2 == 0) return 0.0;
+            return 1 - M4.mean()/(3*m2*m2);
+        }
+
+        //true once both <e> and <|m|> are known to within targetError
+        //(and there are enough samples for the blocking estimate to be trusted)
+        bool converged(double targetError) {
+            if (count() < 16*Blocking::minBlocks) return false;
+            return E.error() <= targetError && absM.error() <= targetError;
+        }
+
+        void reset() {
+            E.reset(); E2.reset(); absM.reset(); M2.reset(); M4.reset();
+        }
+
+        void write(std::ostream &out) {
+            out.write((char*)&spins, sizeof(double));
+            out.write((char*)&T, sizeof(double));
+            E.write(out); E2.write(out); absM.write(out); M2.write(out); M4.write(out);
+        }
+
+        bool read(std::istream &in) {
+            in.read((char*)&spins, sizeof(double));
+            in.read((char*)&T, sizeof(double));
+            return E.read(in) && E2.read(in) && absM.read(in) && M2.read(in) && M4.read(in);
+        }
+
+    private:
+        Blocking E, E2, absM, M2, M4;
+};
+
+#endif
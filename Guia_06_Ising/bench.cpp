@@ -0,0 +1,94 @@
+// Throughput benchmark of the Ising engine
+// compares the generic IsingModel<Hypercubic<2>> against a hand written square lattice
+// kernel doing the same work, and reports the 3D engine on a 128^3 lattice
+// compilation: g++ -O3 -std=c++11 -o bench bench.cpp
+// usage: ./bench [sweeps] (default 20)
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+
+#include "Ising.h"
+
+using namespace std;
+
+//dedicated square lattice kernel: same random words, same acceptance test and same
+//storage as the generic engine, but with the 4 neighbours written out by hand
+class SquareKernel {
+    public:
+        int N;
+        double T;
+        double E_tot = 0.0;
+        double M_tot = 0.0;
+        vector<int8_t> spins;
+        Random rng;
+
+        SquareKernel(int N_, double T_, unsigned long seed) {
+            N = N_;
+            T = T_;
+            rng.seed(seed);
+            spins.resize((long long)N*N);
+            for (long long i = 0; i < (long long)N*N; i++) spins[i] = 2*(int)(rng.next() >> 63)-1;
+            for (int k = 0; k < 5; k++) {
+                double p = exp(-4.0*(k-2)/T);
+                acceptance[k] = (p >= 1.0) ? UINT64_MAX : (uint64_t)ldexp(p, 64);
+            }
+        }
+
+        void sweep() {
+            const int chunk = 2048;
+            uint64_t bits[2*chunk];
+            for (long long done = 0; done < (long long)N*N; done += chunk) {
+                int n = (int)min((long long)chunk, (long long)N*N - done);
+                rng.fillBits(bits, 2*n);
+                for (int k = 0; k < n; k++) {
+                    int y = (int)(((bits[2*k] >> 32) * N) >> 32);
+                    int x = (int)(((bits[2*k] & 0xffffffffULL) * N) >> 32);
+                    int8_t *row = &spins[(long long)y*N];
+                    int8_t *up = &spins[(long long)(y == 0 ? N-1 : y-1)*N];
+                    int8_t *down = &spins[(long long)(y == N-1 ? 0 : y+1)*N];
+                    int s = row[x];
+                    int sum = up[x] + down[x] + row[x == 0 ? N-1 : x-1] + row[x == N-1 ? 0 : x+1];
+                    if (bits[2*k+1] < acceptance[s*sum/2 + 2]) {
+                        row[x] = -s;
+                        E_tot += 2*s*sum;
+                        M_tot -= 2*s;
+                    }
+                }
+            }
+        }
+
+    private:
+        uint64_t acceptance[5];
+};
+
+template <class Model>
+double timeSweeps(Model &g, int sweeps) {
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < sweeps; i++) g.sweep();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void report(string name, double volume, int sweeps, double seconds) {
+    cout << name << ": " << sweeps << " sweeps in " << seconds << " s -> "
+         << volume*sweeps/seconds/1e6 << " Mflips/s (" << seconds/(volume*sweeps)*1e9 << " ns/flip)\n";
+}
+
+int main(int argc, char* argv[]) {
+    int sweeps = (argc > 1) ? atoi(argv[1]) : 20;
+
+    //near the critical temperature, so that a fair fraction of the flips is accepted
+    SquareKernel k(1024, 2.27, 1);
+    Grid g(1024, 2.27, 1);
+    timeSweeps(k, 1);
+    timeSweeps(g, 1);
+    report("2D 1024^2, hand written kernel ", 1024.0*1024, sweeps, timeSweeps(k, sweeps));
+    report("2D 1024^2, IsingModel<2D>      ", 1024.0*1024, sweeps, timeSweeps(g, sweeps));
+
+    CubicGrid c(128, 4.51, 1);
+    timeSweeps(c, 1);
+    report("3D 128^3,  IsingModel<3D>      ", 128.0*128*128, sweeps, timeSweeps(c, sweeps));
+    return 0;
+}
@@ -1,116 +1,171 @@
 // Ising Model simulator
 // possible compilation command: g++ -O3 -std=c++11 -o ising ising_final.cpp
+// make sure to keep Ising.h in the same folder as ising_final.cpp, and ../Common/Profiler.h
 
 #include <iostream>
 #include <fstream>
-#include <random>
-#include <vector>
-#include <cmath>
-#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <iterator>
 
-using namespace std;
+#include "Ising.h"
+#include "../Common/Profiler.h"
 
-//random generator
-random_device rd;
-mt19937 gen(rd());
+using namespace std;
 
-//mod function used to index grid as periodic
-int mod(int x, int N) {
-    return (x % N + N) % N;
+//keeps the first n values of the time series in filename, the ones up to the checkpoint
+//a run restarts from, and drops those written after it, before the run was stopped
+bool truncateSeries(const string &filename, long long n) {
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in.is_open()) return n == 0;
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+    size_t end = 0;
+    for (long long k = 0; k < n; k++) {
+        end = text.find(' ', end);
+        if (end == string::npos) return false;
+        end++;
+    }
+    ofstream out(filename, ios::out | ios::trunc | ios::binary);
+    out.write(text.data(), end);
+    return (bool)out;
 }
 
-class Grid {
-    public:
-        //N will be the grid side length in number of cells
-        int N;
-        double T;
-        double E_tot = 0.0;
-        double M_tot = 0.0;
-        vector<vector<int>> grid;
+template <class Model>
+int simulate(int argc, char* argv[]) {
 
-        Grid(int N_, double T_) {       
-            //seed random generator
-            gen.seed(chrono::high_resolution_clock::now().time_since_epoch().count());
-            N = N_;
-            T = T_;
-            //initialilze grid by filling it with spins
-            for(int y = 0; y < N; y++) {
-                vector<int> tmp_vec;
-                grid.push_back(tmp_vec);
-                for (int x = 0; x < N; x++) {
-                    grid[y].push_back(2*uniform_int_distribution<int>{0, 1}(gen)-1); //this writes a -1 or a 1
-                }
-            }
-            //initialize total Energy and Magentization
-            for(int y = 0; y < N; y++) {
-                for (int x = 0; x < N; x++) {
-                    E_tot += spinE(y, x);
-                    M_tot += grid[y][x];
-                }
-            }
-        }
+    //the following code will simulate a 32x32 grid at T=2.35 for 1000 time units
+    //one sample of E and M is taken on each time unit passage, and the averages,
+    //error bars and autocorrelation times are accumulated while running
+    //options:
+    //  -lattice <name>    square (default), cubic or triangular
+    //  -N <side> -T <temperature> -therm <sweeps> -meas <sweeps> -seed <n>
+    //  -J <coupling> -h <field>   (default J = 1, h = 0)
+    //  -target <error>    stop as soon as <e> and <|m|> are known to within this error
+    //  -series <file>     also save E/spin on every time unit to <file> (as "E_espines.csv" used to)
+    //  -checkpoint <file> save a snapshot of the run to <file> every -every time units (default 1000)
+    //  -restart <file>    continue the run saved in <file> exactly where it stopped
+    //                     (N, T and the averages come from the file)
+    //  -init <file>       start a new run at temperature T from the spins saved in <file>
+    //  -profile <file>    write the time spent sweeping, measuring and saving to <file>,
+    //                     as JSON (see Common/Profiler.h)
+    int N = 32;
+    double T = 2.35;
+    int therm = 0;
+    int meas = 1000;
+    double J = 1.0;
+    double h = 0.0;
+    double target = 0;
+    unsigned long seed = chrono::high_resolution_clock::now().time_since_epoch().count();
+    string seriesFilename, checkpointFilename, restartFilename, initFilename, profileFilename;
+    int every = 1000;
+    for (int i = 1; i+1 < argc; i += 2) {
+        string arg = argv[i];
+        if      (arg == "-N")          N = atoi(argv[i+1]);
+        else if (arg == "-T")          T = atof(argv[i+1]);
+        else if (arg == "-therm")      therm = atoi(argv[i+1]);
+        else if (arg == "-meas")       meas = atoi(argv[i+1]);
+        else if (arg == "-seed")       seed = strtoul(argv[i+1], NULL, 10);
+        else if (arg == "-J")          J = atof(argv[i+1]);
+        else if (arg == "-h")          h = atof(argv[i+1]);
+        else if (arg == "-target")     target = atof(argv[i+1]);
+        else if (arg == "-series")     seriesFilename = argv[i+1];
+        else if (arg == "-checkpoint") checkpointFilename = argv[i+1];
+        else if (arg == "-every")      every = max(1, atoi(argv[i+1]));
+        else if (arg == "-restart")    restartFilename = argv[i+1];
+        else if (arg == "-init")       initFilename = argv[i+1];
+        else if (arg == "-profile")    profileFilename = argv[i+1];
+    }
 
-        //update the grid, and the total energy and magnetization
-        void updateGrid() {
-            //choose random point on grid
-            int y = uniform_int_distribution<int>{0, N-1}(gen);
-            int x = uniform_int_distribution<int>{0, N-1}(gen);
-            //calculate cost of flipping
-            double dE = flipEnergy(y, x);
-            //calculate Boltzmann factor
-            double p = min(1.0, exp(-dE/T));
-            //generate a uniform double in range (0, 1)
-            double w = uniform_real_distribution<>{0, 1}(gen);
-            //check if flip is accepted, and if so, update grid, E and M
-            if (w <= p) {
-                grid[y][x] *= -1;
-                E_tot += 2*spinE(y, x);
-                M_tot += 2*grid[y][x];
-            }
+    //create an N^D lattice, at temperature T, or restore it from a snapshot
+    Model g = Model(1, T, seed);
+    if (!restartFilename.empty()) {
+        if (!g.load(restartFilename)) return -1;
+        cout << "Restarting from " << restartFilename << " after " << g.sweeps() << " time units\n";
+    }
+    else if (!initFilename.empty()) {
+        if (!g.load(initFilename)) return -1;
+        g.setTemperature(T);
+        g.setCouplings(J, h);
+        g.steps = 0;
+        g.rng.seed(seed);
+        cout << "Starting from the spins saved in " << initFilename << "\n";
+    }
+    else {
+        g = Model(N, T, seed, J, h);
+    }
+
+    //open file to save the time series to, if requested. a restarted run appends to it,
+    //after the samples of the checkpoint (one per measurement)
+    ofstream file;
+    if (!seriesFilename.empty()) {
+        if (!restartFilename.empty() && !truncateSeries(seriesFilename, g.obs.count())) {
+            cout << "The series in " << seriesFilename << " is shorter than the checkpoint. Exiting...\n";
+            return -1;
         }
+        file.open(seriesFilename, ios::out | (restartFilename.empty() ? ios::trunc : ios::app));
+    }
+
+    //a step is a time unit, and the items of "sweep" the attempted flips
+    Profiler profiler("ising");
+    profiler.dumpFilename = profileFilename;
+    int sweepPhase = profiler.phase("sweep");
+    int measurePhase = profiler.phase("measure");
+    int io = profiler.phase("io");
+    long long first = g.sweeps();
 
-        double E_per_spin() {
-            return E_tot/N/N;
+    //run therm time units without measuring, then meas time units (meas*N^2 iterations)
+    //measuring once per time unit
+    while (g.sweeps() < therm + meas) {
+        {
+            Profiler::Timer timer(&profiler, sweepPhase, g.volume);
+            g.sweep();
         }
-        double M_per_spin() {
-            return M_tot/N/N;
+        if (g.sweeps() > therm) {
+            Profiler::Timer timer(&profiler, measurePhase);
+            g.measure();
+            if (file.is_open()) file << g.E_per_spin() << " ";
         }
-
-        ~Grid() {}
-    
-    private:
-        //returns the energy of spin at (y, x)
-        double spinE(int y, int x) {
-            return -grid[y][x] * ( grid[mod(y-1, N)][x] + grid[mod(y+1, N)][x] + grid[y][mod(x-1, N)] + grid[y][mod(x+1, N)] );
+        if (!checkpointFilename.empty() && g.sweeps() % every == 0) {
+            Profiler::Timer timer(&profiler, io);
+            if (file.is_open()) file.flush();
+            g.save(checkpointFilename);
         }
-        //returns the energy required to flip spin at (y, x)
-        double flipEnergy(int y, int x) {
-            return -2*spinE(y, x); //why? E_yx' = -E_yx -> dE = E' - E = -2*E_yx
+        if (target > 0 && g.obs.converged(target)) {
+            cout << "\nTarget error reached after " << g.sweeps() << " time units\n";
+            break;
         }
-
-};
-
-int main(int argc, char* argv[]) {
-    
-    //the following code will simulate a 32x32 grid at T=2.35
-    //the energy per spin will be saved on each time unit passage
-    //to file "E_espines.csv"
-
-    //open file to save data to
-    ofstream file;
-    file.open("E_espines.csv", ios::out | ios::trunc);
-
-    //create 32x32 grid, at T=2.35
-    Grid g = Grid(32, 2.35);
-    //run 1000 time units (1000*N^2 iterations)
-    for (int i = 0; i < 1000 * g.N * g.N; i++) {
-        g.updateGrid();
-        //save E/spin to file when a whole time unit has passed
-        if (i % (g.N*g.N) == 0) {
-            file << g.E_per_spin() << " ";
+        if (profiler.due()) {
+            profiler.progress(g.sweeps() - first, (double)(g.sweeps() - first)/(therm + meas - first),
+                              "Time unit: " + to_string(g.sweeps()) + " (max: " + to_string(therm + meas) + ")");
         }
     }
+    profiler.steps = g.sweeps() - first;
+    if (!checkpointFilename.empty()) {
+        Profiler::Timer timer(&profiler, io);
+        g.save(checkpointFilename);
+    }
+    cout << "\nD = " << g.D << ", z = " << g.z << ", N = " << g.N << ", T = " << g.T
+         << ", J = " << g.J << ", h = " << g.h << ", samples = " << g.obs.count() << "\n";
+    cout << " <e>   = " << g.obs.meanE() << " +- " << g.obs.errorE() << "  (tau = " << g.obs.tauE() << ")\n";
+    cout << " <|m|> = " << g.obs.meanAbsM() << " +- " << g.obs.errorAbsM() << "  (tau = " << g.obs.tauAbsM() << ")\n";
+    cout << " C     = " << g.obs.C() << "\n";
+    cout << " chi   = " << g.obs.chi() << "\n";
+    cout << " U     = " << g.obs.binder() << "\n";
+    profiler.summary();
     cout << "\nDone...\n";
-    file.close();
+    if (file.is_open()) file.close();
     return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char* argv[]) {
+    string lattice = "square";
+    for (int i = 1; i+1 < argc; i += 2) {
+        if (string(argv[i]) == "-lattice") lattice = argv[i+1];
+    }
+    if (lattice == "square")     return simulate<Grid>(argc, argv);
+    if (lattice == "cubic")      return simulate<CubicGrid>(argc, argv);
+    if (lattice == "triangular") return simulate<TriangularGrid>(argc, argv);
+    cout << "Unknown lattice: " << lattice << ". Use square, cubic or triangular\n";
+    return -1;
+}
@@ -0,0 +1,262 @@
+// Batch driver for temperature sweeps and finite size scaling of the Ising model
+// every (N, T) point is run on a thread pool, largest lattices first, and the
+// results are streamed to a single table as soon as each point is done
+// compilation: g++ -O3 -std=c++11 -pthread -o sweep sweep.cpp
+// make sure to keep Ising.h in the same folder, and ../Common/ThreadPool.h
+//
+// usage example:
+//   ./sweep -N 16,32,64 -T 1.5:3.5:0.05 -therm 2000 -warm 200 -meas 10000 -threads 8 -o sweep.csv
+//      -N       comma separated list of grid side lengths
+//      -T       temperatures, given either as a comma separated list or as min:max:step
+//      -therm   equilibration sweeps for a cold (random) start
+//      -warm    equilibration sweeps for a point warm started from the previous temperature
+//      -meas    measurement sweeps per point (one sample per sweep)
+//      -target  optional. stop measuring a point as soon as the errors of <e> and <|m|>
+//               are below this value (-meas is then the maximum number of sweeps)
+//      -chains  number of independent warm start chains each N is split into (default 1)
+//      -threads number of worker threads (default: all cores)
+//      -init    optional Ising checkpoint (see Grid::save). chains with the same N start from
+//               its spins instead of a random lattice, and count as warm started
+//      -seed    base seed. each chain uses seed + its index, so runs are reproducible
+//      -o       output table. files ending in ".bin" are written in binary, else as CSV
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+
+#include "Ising.h"
+#include "../Common/ThreadPool.h"
+
+using namespace std;
+
+//one row of the output table
+struct SweepResult {
+    int N;
+    double T;
+    double E;       //<e>, energy per spin
+    double E_err;   //error of <e>, from blocking analysis
+    double C;       //specific heat per spin
+    double M;       //<|m|>, absolute magnetization per spin
+    double M_err;   //error of <|m|>
+    double chi;     //susceptibility per spin
+    double binder;  //Binder cumulant U = 1 - <m^4>/(3<m^2>^2)
+    double tau;     //integrated autocorrelation time of e, in sweeps
+    int sweeps;     //sweeps done for this point (equilibration + measurement)
+    double seconds; //wall time spent on this point
+};
+
+//table the results are streamed to. rows can arrive from any thread
+//binary format: "ISWP", int32 number of columns, then one record of doubles per row
+class ResultTable {
+    public:
+        ResultTable(string filename_) {
+            filename = filename_;
+            binary = filename.size() >= 4 && filename.substr(filename.size()-4) == ".bin";
+            if (binary) {
+                file.open(filename, ios::out | ios::trunc | ios::binary);
+                int32_t nColumns = 12;
+                file.write("ISWP", 4);
+                file.write((char*)&nColumns, sizeof(nColumns));
+            }
+            else {
+                file.open(filename, ios::out | ios::trunc);
+                file << "N,T,E,E_err,C,M,M_err,chi,binder,tau,sweeps,seconds\n";
+            }
+        }
+
+        bool is_open() {
+            return file.is_open();
+        }
+
+        void write(SweepResult r) {
+            lock_guard<mutex> lock(m);
+            if (binary) {
+                double row[12] = {(double)r.N, r.T, r.E, r.E_err, r.C, r.M, r.M_err, r.chi, r.binder,
+                                  r.tau, (double)r.sweeps, r.seconds};
+                file.write((char*)row, sizeof(row));
+            }
+            else {
+                file << r.N << "," << r.T << "," << r.E << "," << r.E_err << "," << r.C << ","
+                     << r.M << "," << r.M_err << "," << r.chi << "," << r.binder << ","
+                     << r.tau << "," << r.sweeps << "," << r.seconds << "\n";
+            }
+            //flush so that a killed sweep still leaves every finished point on disk
+            file.flush();
+        }
+
+        ~ResultTable() {
+            file.close();
+        }
+
+    private:
+        string filename;
+        bool binary;
+        ofstream file;
+        mutex m;
+};
+
+//a chain of temperatures simulated one after the other on the same lattice
+struct Chain {
+    int N;
+    vector<double> temps; //in the order they are visited
+    unsigned long seed;
+};
+
+//parses "a,b,c" into a list of numbers
+vector<double> parseList(string s) {
+    vector<double> values;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) values.push_back(atof(item.c_str()));
+    return values;
+}
+
+//parses either "a,b,c" or "min:max:step", with step > 0 and at most 10^6 points
+//an empty list if the range can't be read
+vector<double> parseTemps(string s) {
+    if (s.find(':') == string::npos) return parseList(s);
+    double T_min, T_max, dT;
+    replace(s.begin(), s.end(), ':', ' ');
+    vector<double> temps;
+    if (!(stringstream(s) >> T_min >> T_max >> dT) || !(dT > 0)) return temps;
+    //the number of points is computed first, so that the rounding of T_min + i*dT
+    //doesn't add or drop the last one
+    double n = floor((T_max - T_min)/dT + 1e-9) + 1;
+    if (!(n >= 1 && n <= 1e6)) return temps;
+    for (int i = 0; i < (int)n; i++) temps.push_back(T_min + i*dT);
+    return temps;
+}
+
+//simulates every temperature of a chain. the first point starts from a random
+//lattice, every following one starts from the lattice left by the previous point
+//a target error of 0 measures every point for the full meas sweeps
+void runChain(Chain c, int therm, int warm, int meas, double target, string initFilename,
+              ResultTable &table, mutex &coutMutex) {
+    Grid g(c.N, c.temps[0], c.seed);
+    bool warmStart = false;
+    if (!initFilename.empty()) {
+        Grid init(initFilename);
+        if (init.N == c.N) {
+            g = init;
+            g.rng.seed(c.seed);
+            warmStart = true;
+        }
+    }
+    for (size_t k = 0; k < c.temps.size(); k++) {
+        auto start = chrono::steady_clock::now();
+        g.setTemperature(c.temps[k]);
+        int eqSweeps = (k == 0 && !warmStart) ? therm : warm;
+        for (int s = 0; s < eqSweeps; s++) g.sweep();
+        int s = 0;
+        while (s < meas) {
+            g.sweep();
+            g.measure();
+            s++;
+            if (target > 0 && g.obs.converged(target)) break;
+        }
+        SweepResult r;
+        r.N = c.N;
+        r.T = g.T;
+        r.E = g.obs.meanE();
+        r.E_err = g.obs.errorE();
+        r.C = g.obs.C();
+        r.M = g.obs.meanAbsM();
+        r.M_err = g.obs.errorAbsM();
+        r.chi = g.obs.chi();
+        r.binder = g.obs.binder();
+        r.tau = g.obs.tauE();
+        r.sweeps = eqSweeps + s;
+        r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        table.write(r);
+        lock_guard<mutex> lock(coutMutex);
+        cout << "N = " << r.N << "  T = " << r.T << "  E = " << r.E << " +- " << r.E_err
+             << "  |M| = " << r.M << " +- " << r.M_err << "  (" << r.sweeps << " sweeps, " << r.seconds << " s)\n" << flush;
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    vector<double> sides {16, 32};
+    vector<double> temps = parseTemps("2.0:2.6:0.05");
+    int therm = 2000;
+    int warm = 200;
+    int meas = 10000;
+    double target = 0;
+    int nChains = 1;
+    int nThreads = 0;
+    unsigned long seed = chrono::high_resolution_clock::now().time_since_epoch().count();
+    string filename = "sweep.csv";
+    string initFilename;
+
+    for (int i = 1; i+1 < argc; i += 2) {
+        string arg = argv[i];
+        if      (arg == "-N")       sides = parseList(argv[i+1]);
+        else if (arg == "-T")       temps = parseTemps(argv[i+1]);
+        else if (arg == "-therm")   therm = atoi(argv[i+1]);
+        else if (arg == "-warm")    warm = atoi(argv[i+1]);
+        else if (arg == "-meas")    meas = atoi(argv[i+1]);
+        else if (arg == "-target")  target = atof(argv[i+1]);
+        else if (arg == "-chains")  nChains = max(1, atoi(argv[i+1]));
+        else if (arg == "-threads") nThreads = atoi(argv[i+1]);
+        else if (arg == "-init")    initFilename = argv[i+1];
+        else if (arg == "-seed")    seed = strtoul(argv[i+1], NULL, 10);
+        else if (arg == "-o")       filename = argv[i+1];
+        else cout << "Ignoring unknown argument: " << arg << "\n";
+    }
+    if (temps.empty()) {
+        cout << "No temperatures to simulate: -T takes a list a,b,c or a range min:max:step with step > 0. Exiting...\n";
+        return -1;
+    }
+
+    ResultTable table(filename);
+    if (!table.is_open()) {
+        cout << "Couldn't open file: " << filename << ". Exiting...\n";
+        return -1;
+    }
+
+    //warm starts go from high to low temperature, so that the random (T = infinity)
+    //lattice of the first point is the closest one to its equilibrium state
+    sort(temps.begin(), temps.end(), greater<double>());
+
+    //split the temperatures of each N into contiguous chains
+    vector<Chain> chains;
+    int nTemps = temps.size();
+    for (size_t n = 0; n < sides.size(); n++) {
+        int perChain = (nTemps + nChains - 1)/nChains;
+        for (int k = 0; k*perChain < nTemps; k++) {
+            Chain c;
+            c.N = (int)sides[n];
+            c.temps.assign(temps.begin() + k*perChain, temps.begin() + min(nTemps, (k+1)*perChain));
+            c.seed = seed + chains.size();
+            chains.push_back(c);
+        }
+    }
+    //largest lattices first, so the longest jobs don't end up running alone at the end
+    stable_sort(chains.begin(), chains.end(), [](const Chain &a, const Chain &b) {
+        return (double)a.N*a.N*a.temps.size() > (double)b.N*b.N*b.temps.size();
+    });
+
+    ThreadPool pool(nThreads);
+    cout << "Running " << sides.size() << " sizes x " << temps.size() << " temperatures as "
+         << chains.size() << " chains on " << pool.size() << " threads\n";
+    cout << "Saving results to: " << filename << "\n\n";
+
+    auto start = chrono::steady_clock::now();
+    mutex coutMutex;
+    for (size_t c = 0; c < chains.size(); c++) {
+        Chain chain = chains[c];
+        pool.submit([=, &table, &coutMutex] { runChain(chain, therm, warm, meas, target, initFilename, table, coutMutex); });
+    }
+    pool.wait();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "\nDone in " << seconds << " s\n";
+    return 0;
+}
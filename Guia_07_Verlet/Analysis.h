@@ -0,0 +1,344 @@
+//On the fly analysis of the Lennard-Jones simulator: structure and dynamics
+// RDF               the radial distribution function g(r), counted by the force evaluation
+//                   of the sampled steps from the distances it computes anyway (see
+//                   Atoms::countPairs): no pass of its own over the pairs
+// StructureFactor   S(k) = |sum_j exp(i k.r_j)|^2 / N, for the k = 2 pi n / L of the box
+//                   (n integer, 0 < |n| <= nMax), averaged over shells of |n|
+// MultiTau          multiple tau correlator (Ramirez, Sukumaran, Vorselaars & Likhtman,
+//                   2010), for the mean squared displacement and the velocity autocorrelation
+// Analysis          all of them on a simulation: S(k), the MSD and the VACF are computed on a
+//                   copy of the state by a background thread, while the simulation goes on
+//
+//with reflecting walls, g(r) and S(k) include the effect of the walls (fewer neighbors
+//near them), and the MSD saturates at the size of the box
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <string>
+#include <vector>
+#include <complex>
+#include <memory>
+#include <atomic>
+#include <fstream>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include "Verlet.h"
+#include "Output.h"
+#include "../Common/ThreadPool.h"
+
+//g(r) in bins of width rMax/bins
+class RDF {
+    public:
+        int bins;
+        double rMax;
+        std::vector<long long> counts;
+        long long samples = 0;
+
+        RDF(int bins_, double rMax_) {
+            bins = bins_;
+            rMax = rMax_;
+            counts.assign(bins, 0);
+        }
+
+        //makes the next force evaluation of atoms count its pairs
+        template <class Atoms>
+        void sample(Atoms &atoms) {
+            atoms.countPairs(&counts, rMax);
+            pairDensity += 0.5*atoms.N*(atoms.N - 1)/atoms.volume();
+            samples++;
+        }
+
+        //g at the center of bin b: the pairs counted in it over those of an ideal gas
+        //of the same density, in D dimensions
+        double g(int b, int D) {
+            const double pi = 3.14159265358979323846;
+            double r1 = b*rMax/bins, r2 = (b+1)*rMax/bins;
+            double shell = (D == 2) ? pi*(r2*r2 - r1*r1) : 4*pi/3*(r2*r2*r2 - r1*r1*r1);
+            return (pairDensity > 0) ? counts[b]/(pairDensity*shell) : 0;
+        }
+
+        //"r g(r)" lines
+        bool save(std::string filename, int D) {
+            std::ofstream file(filename, std::ios::out | std::ios::trunc);
+            if (!file.is_open()) return false;
+            for (int b = 0; b < bins; b++) file << (b + 0.5)*rMax/bins << " " << g(b, D) << "\n";
+            return (bool)file;
+        }
+
+    private:
+        //sum over the samples of the number of pairs over the volume
+        double pairDensity = 0;
+};
+
+class StructureFactor {
+    public:
+        int nMax;
+        long long samples = 0;
+
+        StructureFactor(int nMax_) {
+            nMax = nMax_;
+        }
+
+        //adds S(k) of the positions of frame
+        void add(const Frame &f) {
+            int D = f.D, N = f.N;
+            if (n.empty()) grid(D);
+            int K = n.size()/D;
+            //exp(i 2 pi m x_d / L) for m = 0..nMax, of one particle, from powers of m = 1
+            std::vector<std::complex<double>> e(D*(nMax+1));
+            std::vector<std::complex<double>> rho(K, 0.0);
+            const double pi = 3.14159265358979323846;
+            for (int i = 0; i < N; i++) {
+                for (int d = 0; d < D; d++) {
+                    std::complex<double> *ed = &e[d*(nMax+1)];
+                    ed[0] = 1;
+                    ed[1] = std::polar(1.0, 2*pi*f.x[(size_t)d*N + i]/f.L);
+                    for (int m = 2; m <= nMax; m++) ed[m] = ed[m-1]*ed[1];
+                }
+                for (int k = 0; k < K; k++) {
+                    std::complex<double> p = 1;
+                    for (int d = 0; d < D; d++) {
+                        int m = n[k*D + d];
+                        std::complex<double> em = e[d*(nMax+1) + std::abs(m)];
+                        p *= (m >= 0) ? em : std::conj(em);
+                    }
+                    rho[k] += p;
+                }
+            }
+            for (int k = 0; k < K; k++) {
+                S[shell[k]] += std::norm(rho[k])/N;
+                kSum[shell[k]] += 2*pi/f.L*sqrt((double)norm2[k]);
+                inShell[shell[k]]++;
+            }
+            samples++;
+        }
+
+        //"k S(k)" lines, one per shell of |n| (k its average)
+        bool save(std::string filename) {
+            std::ofstream file(filename, std::ios::out | std::ios::trunc);
+            if (!file.is_open()) return false;
+            for (size_t s = 1; s < S.size(); s++) {
+                if (inShell[s] > 0) file << kSum[s]/inShell[s] << " " << S[s]/inShell[s] << "\n";
+            }
+            return (bool)file;
+        }
+
+    private:
+        //the vectors n (n[k*D + d]), one of each pair n, -n, their |n|^2 and shell round(|n|)
+        std::vector<int> n;
+        std::vector<int> norm2;
+        std::vector<int> shell;
+        std::vector<double> S;
+        std::vector<double> kSum;
+        std::vector<long long> inShell;
+
+        void grid(int D) {
+            int side = 2*nMax + 1, count = 1;
+            for (int d = 0; d < D; d++) count *= side;
+            for (int c = 0; c < count; c++) {
+                int m[3] = {0, 0, 0}, r2 = 0, first = 0;
+                for (int d = 0, rest = c; d < D; d++, rest /= side) {
+                    m[d] = rest % side - nMax;
+                    r2 += m[d]*m[d];
+                    if (first == 0) first = m[d];
+                }
+                if (r2 == 0 || r2 > nMax*nMax || first < 0) continue;
+                for (int d = 0; d < D; d++) n.push_back(m[d]);
+                norm2.push_back(r2);
+                shell.push_back((int)std::lround(sqrt((double)r2)));
+            }
+            S.assign(nMax+1, 0.0);
+            kSum.assign(nMax+1, 0.0);
+            inShell.assign(nMax+1, 0);
+        }
+};
+
+//correlator of channels values sampled together, summed over the channels: the
+//products a(t) a(t + lag), or with differences the squares (a(t + lag) - a(t))^2.
+//level 0 keeps the last p samples, and level l the last p averages of m consecutive
+//values of level l-1, so lags up to p m^(levels-1) samples take p levels values per
+//channel, and every sample about 2p operations per channel
+class MultiTau {
+    public:
+        MultiTau(int channels_, bool differences_, int p_ = 16, int m_ = 2, int levels_ = 16) {
+            C = channels_;
+            differences = differences_;
+            p = p_;
+            m = m_;
+            levels = levels_;
+            buffer.assign((size_t)levels*p*C, 0.0);
+            accumulated.assign((size_t)levels*C, 0.0);
+            accumulatedCount.assign(levels, 0);
+            filled.assign(levels, 0);
+            head.assign(levels, 0);
+            sums.assign(levels*p, 0.0);
+            counts.assign(levels*p, 0);
+        }
+
+        void add(const double *values) {
+            push(0, values);
+        }
+
+        //lags (in samples) and the correlation at them, averaged over the time origins
+        void result(std::vector<double> &lags, std::vector<double> &values) {
+            lags.clear();
+            values.clear();
+            double unit = 1;
+            for (int l = 0; l < levels; l++, unit *= m) {
+                for (int j = (l == 0) ? 0 : p/m; j < p; j++) {
+                    if (counts[l*p + j] == 0) continue;
+                    lags.push_back(j*unit);
+                    values.push_back(sums[l*p + j]/counts[l*p + j]);
+                }
+            }
+        }
+
+    private:
+        int C, p, m, levels;
+        bool differences;
+        //buffer[(l*p + slot)*C + c], the newest value of level l at slot head[l]
+        std::vector<double> buffer;
+        std::vector<double> accumulated;
+        std::vector<int> accumulatedCount;
+        std::vector<int> filled;
+        std::vector<int> head;
+        //sums[l*p + j] of the lag j (in units of m^l samples) of level l
+        std::vector<double> sums;
+        std::vector<long long> counts;
+
+        void push(int l, const double *values) {
+            head[l] = (head[l] + 1) % p;
+            filled[l] = std::min(filled[l] + 1, p);
+            double *newest = &buffer[((size_t)l*p + head[l])*C];
+            std::copy(values, values + C, newest);
+            //the lags below p/m are already done better by the level below
+            for (int j = (l == 0) ? 0 : p/m; j < filled[l]; j++) {
+                const double *old = &buffer[((size_t)l*p + (head[l] - j + p) % p)*C];
+                double s = 0;
+                if (differences) {
+                    for (int c = 0; c < C; c++) s += (newest[c] - old[c])*(newest[c] - old[c]);
+                }
+                else {
+                    for (int c = 0; c < C; c++) s += newest[c]*old[c];
+                }
+                sums[l*p + j] += s;
+                counts[l*p + j]++;
+            }
+            if (l+1 == levels) return;
+            double *a = &accumulated[(size_t)(l+1)*C];
+            for (int c = 0; c < C; c++) a[c] += newest[c];
+            if (++accumulatedCount[l+1] == m) {
+                for (int c = 0; c < C; c++) a[c] /= m;
+                push(l+1, a);
+                std::fill(a, a + C, 0.0);
+                accumulatedCount[l+1] = 0;
+            }
+        }
+};
+
+template <int D, class Boundary>
+class Analysis {
+    public:
+        RDF rdf;
+        StructureFactor structure;
+        MultiTau msd;
+        MultiTau vacf;
+        //time between samples: the mean one once there are two (the timestep may adapt)
+        double interval;
+
+        //g(r) up to rc (up to L/2 without cutoff) in bins bins, S(k) up to |n| = nMax,
+        //and the MSD and VACF of samples taken every interval of time, with lags up to
+        //maxLag samples (their memory grows with its logarithm)
+        Analysis(Atoms<D, Boundary> &atoms, double interval_, int maxLag, int bins = 200, int nMax = 8)
+            : rdf(bins, (atoms.rc > 0) ? atoms.rc : 0.5*atoms.L), structure(nMax),
+              msd(D*atoms.N, true, 16, 2, levelsFor(maxLag)), vacf(D*atoms.N, false, 16, 2, levelsFor(maxLag)),
+              worker(1) {
+            interval = interval_;
+            N = atoms.N;
+        }
+
+        //before a step: its force evaluation counts the pairs for g(r)
+        void beforeStep(Atoms<D, Boundary> &atoms) {
+            rdf.sample(atoms);
+        }
+
+        //after it: copies the positions and velocities, for the background thread. waits
+        //while it still has two samples to do
+        void afterStep(Atoms<D, Boundary> &atoms, double time) {
+            if (pending >= 2) worker.wait();
+            if (samples == 0) firstTime = time;
+            else interval = (time - firstTime)/samples;
+            samples++;
+            std::shared_ptr<Frame> f = takeFrame(atoms, time);
+            pending++;
+            worker.submit([this, f] {
+                dynamics(*f);
+                structure.add(*f);
+                pending--;
+            });
+        }
+
+        //waits until every sample is done
+        void wait() {
+            worker.wait();
+        }
+
+        //saves "<prefix>_rdf.csv" (r g), "<prefix>_sk.csv" (k S), "<prefix>_msd.csv" (t MSD)
+        //and "<prefix>_vacf.csv" (t VACF)
+        bool save(std::string prefix) {
+            wait();
+            bool good = rdf.save(prefix + "_rdf.csv", D) && structure.save(prefix + "_sk.csv");
+            return good && saveCorrelation(msd, prefix + "_msd.csv") &&
+                   saveCorrelation(vacf, prefix + "_vacf.csv");
+        }
+
+    private:
+        int N;
+        long long samples = 0;
+        double firstTime = 0;
+        ThreadPool worker;
+        std::atomic<int> pending{0};
+        //positions without the periodic wrapping, and the wrapped ones of the last sample
+        std::vector<double> unwrapped;
+        std::vector<double> last;
+
+        //levels of a MultiTau (p = 16, m = 2) with lags of at least maxLag samples
+        static int levelsFor(int maxLag) {
+            int levels = 1;
+            for (long long lag = 16; lag < maxLag; lag *= 2) levels++;
+            return levels;
+        }
+
+        void dynamics(const Frame &f) {
+            if (unwrapped.empty()) {
+                unwrapped = f.x;
+                last = f.x;
+            }
+            else {
+                for (size_t k = 0; k < f.x.size(); k++) {
+                    double dx = f.x[k] - last[k];
+                    //a particle moves less than L/2 between samples
+                    if (Boundary::periodic) dx -= f.L*nearest(dx/f.L);
+                    unwrapped[k] += dx;
+                    last[k] = f.x[k];
+                }
+            }
+            msd.add(unwrapped.data());
+            vacf.add(f.v.data());
+        }
+
+        //"t value" lines, per particle
+        bool saveCorrelation(MultiTau &correlator, std::string filename) {
+            std::vector<double> lags, values;
+            correlator.result(lags, values);
+            std::ofstream file(filename, std::ios::out | std::ios::trunc);
+            if (!file.is_open()) return false;
+            for (size_t k = 0; k < lags.size(); k++) file << lags[k]*interval << " " << values[k]/N << "\n";
+            return (bool)file;
+        }
+};
+
+#endif
@@ -0,0 +1,342 @@
+//Vectorized Lennard-Jones pair kernel
+//the forces of many pairs (i, j) are computed at once, with the inverse powers of r
+//made by multiplication from 1/r^2 (no pow), and the pairs beyond the cutoff masked out
+//of the result. the potential energy and the virial of the pairs are summed in the
+//same pass, from the same powers, so they cost a few multiplications more
+//the vector width is picked at compile time: 8 doubles with AVX-512, 4 with AVX2, or
+//plain scalar code otherwise. compile with -march=native to get them
+
+#ifndef LJKERNEL_H
+#define LJKERNEL_H
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//a vector of doubles, and the few operations the kernels need
+#if defined(__AVX512F__)
+struct Vec {
+    static const int width = 8;
+    __m512d v;
+    Vec() {}
+    Vec(__m512d v_) : v(v_) {}
+    Vec(double a) : v(_mm512_set1_pd(a)) {}
+    static Vec load(const double *p) {return _mm512_loadu_pd(p);}
+    void store(double *p) const {_mm512_storeu_pd(p, v);}
+    //p[idx[0]], ..., p[idx[width-1]]
+    static Vec gather(const double *p, const int *idx) {
+        __m256i i = _mm256_loadu_si256((const __m256i*)idx);
+        return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, i, p, 8);
+    }
+};
+inline Vec operator+(Vec a, Vec b) {return _mm512_add_pd(a.v, b.v);}
+inline Vec operator-(Vec a, Vec b) {return _mm512_sub_pd(a.v, b.v);}
+inline Vec operator*(Vec a, Vec b) {return _mm512_mul_pd(a.v, b.v);}
+inline Vec operator/(Vec a, Vec b) {return _mm512_div_pd(a.v, b.v);}
+inline Vec sqrt(Vec a) {return _mm512_mask_sqrt_pd(a.v, 0xFF, a.v);}
+inline Vec clampUnit(Vec a) {
+    __m512d one = _mm512_set1_pd(1.0);
+    return _mm512_mask_min_pd(one, 0xFF, _mm512_mask_max_pd(one, 0xFF, a.v, _mm512_setzero_pd()), one);
+}
+//value in the lanes where r2 < limit, 0 in the others
+inline Vec below(Vec r2, Vec limit, Vec value) {
+    return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(r2.v, limit.v, _CMP_LT_OQ), value.v);
+}
+//rounded to the nearest integer
+inline Vec nearest(Vec a) {
+    return _mm512_mask_roundscale_pd(a.v, 0xFF, a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+#elif defined(__AVX2__)
+struct Vec {
+    static const int width = 4;
+    __m256d v;
+    Vec() {}
+    Vec(__m256d v_) : v(v_) {}
+    Vec(double a) : v(_mm256_set1_pd(a)) {}
+    static Vec load(const double *p) {return _mm256_loadu_pd(p);}
+    void store(double *p) const {_mm256_storeu_pd(p, v);}
+    static Vec gather(const double *p, const int *idx) {
+        __m128i i = _mm_loadu_si128((const __m128i*)idx);
+        __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), p, i, all, 8);
+    }
+};
+inline Vec operator+(Vec a, Vec b) {return _mm256_add_pd(a.v, b.v);}
+inline Vec operator-(Vec a, Vec b) {return _mm256_sub_pd(a.v, b.v);}
+inline Vec operator*(Vec a, Vec b) {return _mm256_mul_pd(a.v, b.v);}
+inline Vec operator/(Vec a, Vec b) {return _mm256_div_pd(a.v, b.v);}
+inline Vec sqrt(Vec a) {return _mm256_sqrt_pd(a.v);}
+inline Vec clampUnit(Vec a) {return _mm256_min_pd(_mm256_max_pd(a.v, _mm256_setzero_pd()), _mm256_set1_pd(1.0));}
+inline Vec below(Vec r2, Vec limit, Vec value) {
+    return _mm256_and_pd(_mm256_cmp_pd(r2.v, limit.v, _CMP_LT_OQ), value.v);
+}
+inline Vec nearest(Vec a) {return _mm256_round_pd(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);}
+#else
+struct Vec {
+    static const int width = 1;
+    double v;
+    Vec() {}
+    Vec(double a) : v(a) {}
+    static Vec load(const double *p) {return *p;}
+    void store(double *p) const {*p = v;}
+    static Vec gather(const double *p, const int *idx) {return p[*idx];}
+};
+inline Vec operator+(Vec a, Vec b) {return a.v + b.v;}
+inline Vec operator-(Vec a, Vec b) {return a.v - b.v;}
+inline Vec operator*(Vec a, Vec b) {return a.v * b.v;}
+inline Vec operator/(Vec a, Vec b) {return a.v / b.v;}
+inline Vec sqrt(Vec a) {return std::sqrt(a.v);}
+inline Vec clampUnit(Vec a) {return std::min(std::max(a.v, 0.0), 1.0);}
+inline Vec below(Vec r2, Vec limit, Vec value) {return (r2.v < limit.v) ? value.v : 0.0;}
+inline Vec nearest(Vec a) {return std::nearbyint(a.v);}
+#endif
+inline double nearest(double a) {return std::nearbyint(a);}
+//to [0, 1]
+inline double clampUnit(double a) {return std::min(std::max(a, 0.0), 1.0);}
+
+//force between two particles at squared distance r2, divided by their distance:
+//24 (2 r^-14 - r^-8) = 24 r^-2 r^-6 (2 r^-6 - 1), and their potential energy minus
+//shift: 4 (r^-12 - r^-6) - shift
+template <class T>
+inline void ljPair(T r2, T shift, T &f, T &u) {
+    T inv2 = T(1.0)/r2;
+    T inv6 = inv2*inv2*inv2;
+    f = T(24.0)*inv2*inv6*(T(2.0)*inv6 - T(1.0));
+    u = T(4.0)*inv6*(inv6 - T(1.0)) - shift;
+}
+
+//for multiple time stepping (see Atoms::setRespa) the potential U is split into a short
+//range part S U and a long range part (1 - S) U, with S going smoothly from 1 below r1 to
+//0 beyond r2, as the cubic 1 - 3t^2 + 2t^3 of t = (r^2 - r1^2)/(r2^2 - r1^2)
+struct Split {
+    double r1sq = 0;
+    double invWidth = 0;    //1/(r2^2 - r1^2)
+};
+
+//replaces the f and u of ljPair by those of part 1 (short range) or 2 (long range) of
+//the potential. part 0 (all of it) leaves them
+template <int part, class T>
+inline void ljSplit(T r2, const Split &split, T &f, T &u) {
+    if (part == 0) return;
+    T t = clampUnit((r2 - T(split.r1sq))*T(split.invWidth));
+    T S = T(1.0) - t*t*(T(3.0) - T(2.0)*t);
+    //f is -2 dU/dr^2, so that of S U has -2 U dS/dr^2 more
+    T dS = T(-6.0*split.invWidth)*t*(T(1.0) - t);
+    T fShort = S*f - T(2.0)*u*dS;
+    T uShort = S*u;
+    f = (part == 1) ? fShort : f - fShort;
+    u = (part == 1) ? uShort : u - uShort;
+}
+
+//potential of two particles at squared distance r2: 4 (r^-12 - r^-6)
+inline double ljPotential(double r2) {
+    double inv6 = 1.0/(r2*r2*r2);
+    return 4*inv6*(inv6 - 1);
+}
+
+//sum of the lanes of v
+inline double sum(Vec v) {
+    double lanes[Vec::width];
+    v.store(lanes);
+    double s = 0;
+    for (int k = 0; k < Vec::width; k++) s += lanes[k];
+    return s;
+}
+
+//the kernels work in D dimensions: x[d] and a[d] are the coordinates and accelerations
+//along axis d. box.image(dx) maps a difference of coordinates to the one between the
+//nearest images of the particles (see the boundaries in Verlet.h), for doubles and Vecs
+//the box is copied, so that the compiler knows the stores to a[d] don't change it
+
+//adds the forces between particle i and the particles first to first+n-1 closer than
+//sqrt(rc2) to the accelerations (unit masses) of both, their potential energy (shifted
+//by shift) to energy and their virial r.F to virial. the j are contiguous, so they are
+//loaded, and their accelerations updated, a vector at a time
+template <int D, class Box>
+inline void ljRow(int i, int first, int n, const double *const *x, double *const *a, Box box,
+                  double rc2, double shift, double &energy, double &virial) {
+    Vec xi[D], fi[D];
+    for (int d = 0; d < D; d++) {
+        xi[d] = Vec(x[d][i]);
+        fi[d] = Vec(0.0);
+    }
+    Vec limit(rc2), shiftV(shift), uSum(0.0), wSum(0.0);
+    int k = first;
+    for (; k + Vec::width <= first + n; k += Vec::width) {
+        Vec dx[D];
+        for (int d = 0; d < D; d++) dx[d] = box.image(xi[d] - Vec::load(x[d] + k));
+        Vec r2 = dx[0]*dx[0];
+        for (int d = 1; d < D; d++) r2 = r2 + dx[d]*dx[d];
+        Vec f, u;
+        ljPair(r2, shiftV, f, u);
+        f = below(r2, limit, f);
+        uSum = uSum + below(r2, limit, u);
+        wSum = wSum + f*r2;
+        for (int d = 0; d < D; d++) {
+            Vec fd = dx[d]*f;
+            fi[d] = fi[d] + fd;
+            (Vec::load(a[d] + k) - fd).store(a[d] + k);
+        }
+    }
+    double s[D];
+    for (int d = 0; d < D; d++) s[d] = sum(fi[d]);
+    double su = sum(uSum), sw = sum(wSum);
+    for (; k < first + n; k++) {
+        double dx[D];
+        for (int d = 0; d < D; d++) dx[d] = box.image(x[d][i] - x[d][k]);
+        double r2 = dx[0]*dx[0];
+        for (int d = 1; d < D; d++) r2 += dx[d]*dx[d];
+        if (r2 >= rc2) continue;
+        double f, u;
+        ljPair(r2, shift, f, u);
+        su += u;
+        sw += f*r2;
+        for (int d = 0; d < D; d++) {
+            s[d] += dx[d]*f;
+            a[d][k] -= dx[d]*f;
+        }
+    }
+    for (int d = 0; d < D; d++) a[d][i] += s[d];
+    energy += su;
+    virial += sw;
+}
+
+//adds the forces of the n pairs (pi[k], pj[k]) closer than sqrt(rc2) to the
+//accelerations of both particles, and their energy and virial as ljRow does
+//in a neighbor list each particle has only a few pairs, so the vectors run over the
+//pairs of the whole list instead of over the pairs of one particle: the forces of a
+//block of pairs are computed a vector at a time (the costly part), then added to the
+//particles one by one (a particle can appear several times in a block)
+//with a histogram, the pairs closer than bins/binsPerUnit are also counted in
+//histogram[(int)(r*binsPerUnit)], from the distances the forces were computed with
+//part 1 or 2 computes only that part of the potential (see ljSplit)
+template <int D, int part = 0, class Box>
+inline void ljPairList(const int *pi, const int *pj, int n, const double *const *x, double *const *a,
+                       Box box, double rc2, double shift, double &energy, double &virial,
+                       long long *histogram = NULL, int bins = 0, double binsPerUnit = 0,
+                       Split split = Split()) {
+    const int block = 256;
+    double fb[D][block];
+    double rb[block];
+    Vec limit(rc2), shiftV(shift), binScale(binsPerUnit);
+    Vec uSum(0.0), wSum(0.0);
+    double su = 0, sw = 0;
+    for (int b = 0; b < n; b += block) {
+        int m = std::min(block, n - b);
+        const int *bi = pi + b, *bj = pj + b;
+        int k = 0;
+        for (; k + Vec::width <= m; k += Vec::width) {
+            Vec dx[D];
+            for (int d = 0; d < D; d++) {
+                dx[d] = box.image(Vec::gather(x[d], bi + k) - Vec::gather(x[d], bj + k));
+            }
+            Vec r2 = dx[0]*dx[0];
+            for (int d = 1; d < D; d++) r2 = r2 + dx[d]*dx[d];
+            Vec f, u;
+            ljPair(r2, shiftV, f, u);
+            ljSplit<part>(r2, split, f, u);
+            f = below(r2, limit, f);
+            uSum = uSum + below(r2, limit, u);
+            wSum = wSum + f*r2;
+            for (int d = 0; d < D; d++) (dx[d]*f).store(fb[d] + k);
+            if (histogram) (sqrt(r2)*binScale).store(rb + k);
+        }
+        for (; k < m; k++) {
+            double dx[D];
+            for (int d = 0; d < D; d++) dx[d] = box.image(x[d][bi[k]] - x[d][bj[k]]);
+            double r2 = dx[0]*dx[0];
+            for (int d = 1; d < D; d++) r2 += dx[d]*dx[d];
+            double f = 0, u = 0;
+            if (r2 < rc2) {
+                ljPair(r2, shift, f, u);
+                ljSplit<part>(r2, split, f, u);
+            }
+            su += u;
+            sw += f*r2;
+            for (int d = 0; d < D; d++) fb[d][k] = dx[d]*f;
+            rb[k] = sqrt(r2)*binsPerUnit;
+        }
+        if (histogram) {
+            for (k = 0; k < m; k++) {
+                //without a branch: the pairs past the last bin add 0 to the first one
+                int bin = (int)rb[k];
+                bool in = bin < bins;
+                histogram[in ? bin : 0] += in;
+            }
+        }
+        //consecutive pairs of the same i (the usual case in a list sorted by i) are summed
+        //in registers before being added to it
+        int i = bi[0];
+        double s[D] = {};
+        for (k = 0; k < m; k++) {
+            if (bi[k] != i) {
+                for (int d = 0; d < D; d++) {
+                    a[d][i] += s[d];
+                    s[d] = 0;
+                }
+                i = bi[k];
+            }
+            for (int d = 0; d < D; d++) {
+                s[d] += fb[d][k];
+                a[d][bj[k]] -= fb[d][k];
+            }
+        }
+        for (int d = 0; d < D; d++) a[d][i] += s[d];
+    }
+    energy += su + sum(uSum);
+    virial += sw + sum(wSum);
+}
+
+//adds the forces on particle i (only) of the n particles j[0], ..., j[n-1] closer than
+//sqrt(rc2) to f[0], ..., f[D-1], and their energy and virial as ljRow does. a NULL j
+//means the contiguous particles first to first+n-1. nothing is written to the other
+//particles, so several threads can sum the forces of different i at once
+template <int D, class Box>
+inline void ljSum(int i, const int *j, int first, int n, const double *const *x, Box box,
+                  double rc2, double shift, double *f, double &energy, double &virial) {
+    Vec xi[D], fi[D];
+    for (int d = 0; d < D; d++) {
+        xi[d] = Vec(x[d][i]);
+        fi[d] = Vec(0.0);
+    }
+    Vec limit(rc2), shiftV(shift), uSum(0.0), wSum(0.0);
+    int k = 0;
+    for (; k + Vec::width <= n; k += Vec::width) {
+        Vec dx[D];
+        for (int d = 0; d < D; d++) {
+            dx[d] = box.image(xi[d] - (j ? Vec::gather(x[d], j + k) : Vec::load(x[d] + first + k)));
+        }
+        Vec r2 = dx[0]*dx[0];
+        for (int d = 1; d < D; d++) r2 = r2 + dx[d]*dx[d];
+        Vec fk, u;
+        ljPair(r2, shiftV, fk, u);
+        fk = below(r2, limit, fk);
+        uSum = uSum + below(r2, limit, u);
+        wSum = wSum + fk*r2;
+        for (int d = 0; d < D; d++) fi[d] = fi[d] + dx[d]*fk;
+    }
+    double s[D];
+    for (int d = 0; d < D; d++) s[d] = sum(fi[d]);
+    double su = sum(uSum), sw = sum(wSum);
+    for (; k < n; k++) {
+        int m = j ? j[k] : first + k;
+        double dx[D];
+        for (int d = 0; d < D; d++) dx[d] = box.image(x[d][i] - x[d][m]);
+        double r2 = dx[0]*dx[0];
+        for (int d = 1; d < D; d++) r2 += dx[d]*dx[d];
+        if (r2 >= rc2) continue;
+        double fk, u;
+        ljPair(r2, shift, fk, u);
+        su += u;
+        sw += fk*r2;
+        for (int d = 0; d < D; d++) s[d] += dx[d]*fk;
+    }
+    for (int d = 0; d < D; d++) f[d] += s[d];
+    energy += su;
+    virial += sw;
+}
+
+#endif
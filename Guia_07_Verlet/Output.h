@@ -0,0 +1,212 @@
+//Output of the Lennard-Jones simulator: trajectory frames and the energy log
+//the simulation only copies the state (or the numbers to log), and the encoding and
+//the disk I/O happen on the thread of an AsyncWriter (see Common/AsyncWriter.h), which
+//holds at most two frames: the integrator only waits if the disk is slower than that
+//
+//the frames of a trajectory are appended to one file, in a format chosen by the
+//extension of the filename:
+// .trj  binary frames: "LJTF", int32 version (1), int32 D, int32 N, int32 format,
+//       int64 step, float64 time, float64 L, then the positions x[0][0..N-1] to
+//       x[D-1][0..N-1] and the velocities in the same order (little endian, as the
+//       machine writes them)
+//       format 0: float32 positions and velocities (8 D bytes per particle)
+//       format 1: fixed point, half the size: uint16 positions in units of L/65536,
+//       then a float32 scale and int16 velocities in units of it (scale = largest
+//       |v| / 32767)
+//       the header is 44 bytes, so in a file of format 0 frames, frame k starts at
+//       k*(44 + 8*D*N). numpy: np.fromfile(f, "<f4", 2*D*N, offset=k*(44 + 8*D*N) + 44)
+// .xyz  extended XYZ text: N, a line with the box, the step and the time, then a line
+//       "Ar x y z vx vy vz" per particle (z = vz = 0 in 2D). readable by OVITO or ASE
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <initializer_list>
+
+#include "../Common/AsyncWriter.h"
+
+inline bool hasExtension(const std::string &filename, const std::string &extension) {
+    return filename.size() >= extension.size() &&
+           filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+template <class T>
+void appendRaw(std::string &out, T value) {
+    out.append((const char*)&value, sizeof(T));
+}
+
+//a copy of the state of the simulation: x[d*N + i] is the coordinate of particle i
+//along axis d, and v the same for the velocities
+struct Frame {
+    int D;
+    int N;
+    long long step;
+    double time;
+    double L;
+    std::vector<double> x;
+    std::vector<double> v;
+};
+
+//copies the state of atoms (an Atoms<D, Boundary>) at time
+template <class Atoms>
+std::shared_ptr<Frame> takeFrame(const Atoms &atoms, double time) {
+    std::shared_ptr<Frame> f(new Frame);
+    int D = sizeof(atoms.x)/sizeof(atoms.x[0]);
+    f->D = D;
+    f->N = atoms.N;
+    f->step = atoms.steps;
+    f->time = time;
+    f->L = atoms.L;
+    f->x.resize((size_t)D*atoms.N);
+    f->v.resize((size_t)D*atoms.N);
+    for (int d = 0; d < D; d++) {
+        std::copy(atoms.x[d].begin(), atoms.x[d].end(), f->x.begin() + (size_t)d*atoms.N);
+        std::copy(atoms.v[d].begin(), atoms.v[d].end(), f->v.begin() + (size_t)d*atoms.N);
+    }
+    return f;
+}
+
+inline std::string encodeFrame(const Frame &f, bool fixedPoint) {
+    std::string out("LJTF");
+    appendRaw<int32_t>(out, 1);
+    appendRaw<int32_t>(out, f.D);
+    appendRaw<int32_t>(out, f.N);
+    appendRaw<int32_t>(out, fixedPoint ? 1 : 0);
+    appendRaw<int64_t>(out, f.step);
+    appendRaw<double>(out, f.time);
+    appendRaw<double>(out, f.L);
+    size_t n = f.x.size();
+    if (!fixedPoint) {
+        std::vector<float> values(2*n);
+        for (size_t k = 0; k < n; k++) values[k] = (float)f.x[k];
+        for (size_t k = 0; k < n; k++) values[n + k] = (float)f.v[k];
+        out.append((const char*)values.data(), values.size()*sizeof(float));
+        return out;
+    }
+    std::vector<uint16_t> positions(n);
+    double toUnits = 65536/f.L;
+    for (size_t k = 0; k < n; k++) {
+        positions[k] = (uint16_t)std::min(65535.0, std::max(0.0, f.x[k]*toUnits));
+    }
+    out.append((const char*)positions.data(), n*sizeof(uint16_t));
+    double vmax = 0;
+    for (size_t k = 0; k < n; k++) vmax = std::max(vmax, std::fabs(f.v[k]));
+    float scale = (vmax > 0) ? (float)(vmax/32767) : 1.0f;
+    appendRaw<float>(out, scale);
+    std::vector<int16_t> velocities(n);
+    for (size_t k = 0; k < n; k++) velocities[k] = (int16_t)std::lround(f.v[k]/scale);
+    out.append((const char*)velocities.data(), n*sizeof(int16_t));
+    return out;
+}
+
+inline std::string encodeXYZ(const Frame &f) {
+    std::string out;
+    out.reserve(64 + (size_t)f.N*80);
+    char line[256];
+    int n = snprintf(line, sizeof(line), "%d\nLattice=\"%.10g 0 0 0 %.10g 0 0 0 %.10g\" "
+                     "Properties=species:S:1:pos:R:3:vel:R:3 Step=%lld Time=%.10g\n",
+                     f.N, f.L, f.L, f.L, f.step, f.time);
+    out.append(line, n);
+    for (int i = 0; i < f.N; i++) {
+        double r[3] = {0, 0, 0}, u[3] = {0, 0, 0};
+        for (int d = 0; d < f.D && d < 3; d++) {
+            r[d] = f.x[(size_t)d*f.N + i];
+            u[d] = f.v[(size_t)d*f.N + i];
+        }
+        n = snprintf(line, sizeof(line), "Ar %.6f %.6f %.6f %.6f %.6f %.6f\n",
+                     r[0], r[1], r[2], u[0], u[1], u[2]);
+        out.append(line, n);
+    }
+    return out;
+}
+
+//the frame in the format of the extension of filename (.xyz, or else .trj)
+inline std::string encodeFrame(const std::string &filename, const Frame &f, bool fixedPoint) {
+    if (hasExtension(filename, ".xyz")) return encodeXYZ(f);
+    return encodeFrame(f, fixedPoint);
+}
+
+//a trajectory file, emptied when opened: every add() appends a frame
+class Trajectory {
+    public:
+        std::string filename;
+        bool fixedPoint;
+        long long frames = 0;
+
+        Trajectory(AsyncWriter &writer_, std::string filename_, bool fixedPoint_ = false) : writer(writer_) {
+            filename = filename_;
+            fixedPoint = fixedPoint_;
+            writer.write(filename, std::string());
+        }
+
+        //copies the state of atoms, to be encoded and written on the writer's thread
+        template <class Atoms>
+        void add(const Atoms &atoms, double time) {
+            std::shared_ptr<Frame> f = takeFrame(atoms, time);
+            std::string name = filename;
+            bool fixed = fixedPoint;
+            writer.write(filename, [name, f, fixed] { return encodeFrame(name, *f, fixed); }, true);
+            frames++;
+        }
+
+    private:
+        AsyncWriter &writer;
+};
+
+//a text file with a line of columns per add(), emptied when opened. the values are
+//kept in blocks of rows lines, which the writer thread formats (as an ostream would,
+//6 significant digits) and appends, so the simulation never waits for the disk
+class EnergyLog {
+    public:
+        EnergyLog(AsyncWriter &writer_, std::string filename_, std::string header = "", int rows_ = 1024)
+            : writer(writer_) {
+            filename = filename_;
+            rows = (size_t)std::max(1, rows_);
+            writer.write(filename, header);
+        }
+
+        void add(std::initializer_list<double> values) {
+            if (columns == 0) columns = values.size();
+            block.insert(block.end(), values.begin(), values.end());
+            if (block.size() >= rows*columns) flush();
+        }
+
+        //hands the lines added so far to the writer
+        void flush() {
+            if (block.empty()) return;
+            std::shared_ptr<std::vector<double>> values(new std::vector<double>());
+            values->swap(block);
+            block.reserve(rows*columns);
+            size_t n = columns;
+            writer.write(filename, [values, n] {
+                std::string out;
+                char number[32];
+                for (size_t k = 0; k < values->size(); k++) {
+                    int length = snprintf(number, sizeof(number), "%g", (*values)[k]);
+                    out.append(number, length);
+                    out.push_back((k % n == n-1) ? '\n' : ' ');
+                }
+                return out;
+            }, true);
+        }
+
+        ~EnergyLog() {
+            flush();
+        }
+
+    private:
+        AsyncWriter &writer;
+        std::string filename;
+        size_t rows;
+        size_t columns = 0;
+        std::vector<double> block;
+};
+
+#endif
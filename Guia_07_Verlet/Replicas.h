@@ -0,0 +1,189 @@
+//Ensembles of independent replicas of the Lennard-Jones simulator (see Verlet.h)
+//many small boxes (e.g. 30 x 30 particles, too few to share among threads) are run in
+//one process: every replica is single threaded, and a ThreadPool runs them side by side,
+//a replica per task, so its particles stay in the cache of one core and the threads
+//never wait for each other within a step. every replica has its own seed, for the
+//initial velocities and the Langevin noise, and its observables are averaged over
+//time. the averages of the replicas at the same density are then combined into a mean
+//and its standard error
+
+#ifndef REPLICAS_H
+#define REPLICAS_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+#include "Verlet.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/Profiler.h"
+
+//time averages of a replica, per particle for the energies
+struct ReplicaResult {
+    double density = 0;
+    uint64_t seed = 0;
+    long long samples = 0;
+    double E_tot = 0;
+    double E_pot = 0;
+    double T = 0;
+    double P = 0;
+};
+
+template <int D, class Boundary>
+class Replicas {
+    public:
+        //sets up a replica before its run (temperature, thermostat...), with its seed
+        typedef std::function<void(Atoms<D, Boundary>&, uint64_t)> Setup;
+
+        //one per replica, in the order they were added
+        std::vector<ReplicaResult> results;
+        //wall time of the last run, and the steps it did over all the replicas
+        double seconds = 0;
+        long long replicaSteps = 0;
+
+        //replicas of N_c^D particles with timestep h, cutoff rc and skin, run on nThreads
+        //threads
+        Replicas(int N_c_, double h_, double rc_, double skin_, int nThreads) : pool(nThreads) {
+            N_c = N_c_;
+            h = h_;
+            rc = rc_;
+            skin = skin_;
+        }
+
+        //a replica at density, whose velocities are drawn with seed
+        void add(double density, uint64_t seed) {
+            ReplicaResult r;
+            r.density = density;
+            r.seed = seed;
+            results.push_back(r);
+        }
+
+        //runs every replica for steps steps, sampling every "every" steps after the first
+        //equilibration ones. the progress is printed to profiler, if not NULL
+        void run(int steps, int equilibration, int every, Setup setup, Profiler *profiler = NULL) {
+            std::atomic<long long> done{0};
+            auto start = std::chrono::steady_clock::now();
+            for (size_t k = 0; k < results.size(); k++) {
+                pool.submit([this, k, steps, equilibration, every, &setup, &done] {
+                    ReplicaResult &r = results[k];
+                    Atoms<D, Boundary> g(N_c, h, r.density, rc, skin, 1, false, r.seed, false);
+                    if (setup) setup(g, r.seed);
+                    ReplicaResult sum = r;
+                    for (int s = 1; s <= steps; s++) {
+                        g.updateParticles();
+                        if (s > equilibration && s % every == 0) {
+                            sum.samples++;
+                            sum.E_tot += g.E_tot();
+                            sum.E_pot += g.E_pot();
+                            sum.T += g.temperature();
+                            sum.P += g.pressure();
+                        }
+                        //counted in blocks, not to share a cache line every step
+                        if (s % 64 == 0 || s == steps) done += (s % 64 == 0) ? 64 : s % 64;
+                    }
+                    if (sum.samples > 0) {
+                        double n = sum.samples;
+                        sum.E_tot /= n*g.N;
+                        sum.E_pot /= n*g.N;
+                        sum.T /= n;
+                        sum.P /= n;
+                    }
+                    r = sum;
+                });
+            }
+            long long total = (long long)results.size()*steps;
+            while (profiler && done < total) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                if (profiler->due()) {
+                    profiler->progress(done, (double)done/total, "Replica-steps: " + std::to_string(done));
+                }
+            }
+            pool.wait();
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            replicaSteps = total;
+        }
+
+        //replica-steps per second of the last run
+        double throughput() {
+            return (seconds > 0) ? replicaSteps/seconds : 0;
+        }
+
+        //the mean and standard error over the replicas at every density
+        void summary(std::ostream &out) {
+            std::vector<double> densities;
+            for (const ReplicaResult &r : results) {
+                if (std::find(densities.begin(), densities.end(), r.density) == densities.end()) {
+                    densities.push_back(r.density);
+                }
+            }
+            char line[256];
+            out << "\n density replicas  E_tot/N               E_pot/N               "
+                << "T                     P\n";
+            for (double density : densities) {
+                std::vector<const ReplicaResult*> group;
+                for (const ReplicaResult &r : results) {
+                    if (r.density == density) group.push_back(&r);
+                }
+                double mean[4], error[4];
+                for (int q = 0; q < 4; q++) {
+                    meanError(group, q, mean[q], error[q]);
+                }
+                snprintf(line, sizeof(line), " %7.4g %8d", density, (int)group.size());
+                out << line;
+                for (int q = 0; q < 4; q++) {
+                    snprintf(line, sizeof(line), "  %9.5f +- %-8.2g", mean[q], error[q]);
+                    out << line;
+                }
+                out << "\n";
+            }
+            snprintf(line, sizeof(line), "\n %lld replica-steps in %.3f s: %.0f replica-steps/s "
+                     "(%zu replicas on %d threads)\n", replicaSteps, seconds, throughput(),
+                     results.size(), pool.size());
+            out << line;
+        }
+
+        //a line "density seed samples E_tot/N E_pot/N T P" per replica
+        bool save(std::string filename) {
+            std::ofstream file(filename, std::ios::out | std::ios::trunc);
+            if (!file.is_open()) return false;
+            for (const ReplicaResult &r : results) {
+                file << r.density << " " << r.seed << " " << r.samples << " " << r.E_tot << " "
+                     << r.E_pot << " " << r.T << " " << r.P << "\n";
+            }
+            return (bool)file;
+        }
+
+    private:
+        int N_c;
+        double h;
+        double rc;
+        double skin;
+        ThreadPool pool;
+
+        //mean over group of observable q (E_tot, E_pot, T, P), and its standard error
+        //(0 with a single replica)
+        static void meanError(const std::vector<const ReplicaResult*> &group, int q, double &mean,
+                              double &error) {
+            int n = group.size();
+            double sum = 0, sum2 = 0;
+            for (const ReplicaResult *r : group) {
+                double value = (q == 0) ? r->E_tot : (q == 1) ? r->E_pot : (q == 2) ? r->T : r->P;
+                sum += value;
+                sum2 += value*value;
+            }
+            mean = sum/n;
+            double variance = (n > 1) ? std::max(0.0, (sum2 - n*mean*mean)/(n - 1)) : 0.0;
+            error = sqrt(variance/n);
+        }
+};
+
+#endif
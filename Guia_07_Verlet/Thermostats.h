@@ -0,0 +1,205 @@
+//Thermostats and barostats of the Lennard-Jones simulator (see Verlet.h)
+//a step of the integrator is two fused passes over the particles:
+//  start: v = scale v + kick a, then x = grow x + drift v (with Langevin, two half
+//         drifts around v = friction v + noise xi, the BAOAB splitting)
+//  end:   after the forces, v = scale2 v + kick2 a
+//the stages only set these coefficients, once per step, from the kinetic energy, the
+//virial and the volume. so a thermostatted or barostatted step costs about the same as
+//a plain (NVE) one, and a stage that does nothing leaves velocity Verlet
+//
+//there are Nf = D N degrees of freedom, and the masses and k_B are 1
+
+#ifndef THERMOSTATS_H
+#define THERMOSTATS_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+#include "../Common/Random.h"
+
+//coefficients of the two passes of a step of length h
+struct Step {
+    double scale = 1, kick;     //start: v = scale v + kick a
+    double grow = 1, drift;     //x = grow x + drift v
+    bool langevin = false;      //if set, the drift is done in two halves around
+    double friction = 1;        //v = friction v + noise xi, with xi of unit variance
+    double noise = 0;
+    double scale2 = 1, kick2;   //end: v = scale2 v + kick2 a
+    Step(double h) {
+        kick = 0.5*h;
+        kick2 = 0.5*h;
+        drift = h;
+    }
+};
+
+//sinh(x)/x
+inline double sinhc(double x) {
+    return (fabs(x) < 1e-4) ? 1 + x*x/6 : sinh(x)/x;
+}
+
+class Thermostat {
+    public:
+        //none: constant energy (NVE)
+        //berendsen: the velocities are scaled every step so that the temperature relaxes
+        //to T0 with time constant tau (doesn't give the canonical distribution)
+        //langevin: friction 1/tau and the matching Gaussian noise (BAOAB)
+        //noseHoover: a chain of length chain, with masses N_f T0 tau^2 and T0 tau^2
+        enum Kind {none, berendsen, langevin, noseHoover};
+        Kind kind = none;
+        double T0 = 1;
+        double tau = 1;
+        int chain = 3;
+        //energy taken from the particles so far (negative if given to them)
+        double work = 0;
+        //key of the counter based Langevin noise (see seed)
+        uint64_t noiseKey = 0;
+
+        void seed(uint64_t seed_) {
+            uint64_t z = seed_;
+            noiseKey = Random::splitmix64(z);
+        }
+
+        //start of a step of length h, with kinetic energy K of Nf degrees of freedom.
+        //K is updated to the kinetic energy after the rescaling
+        void begin(Step &c, double &K, int Nf, double h) {
+            if (kind == berendsen && K > 0) {
+                double T = 2*K/Nf;
+                double s = sqrt(std::max(0.0, 1 + h/tau*(T0/T - 1)));
+                work += (1 - s*s)*K;
+                rescale(c, K, s);
+            }
+            if (kind == noseHoover) {
+                //the half step that ends the previous step, and the one that starts this
+                //one (the splitting is NHC/2 Verlet NHC/2)
+                rescale(c, K, chainHalfStep(K, Nf, h));
+                rescale(c, K, chainHalfStep(K, Nf, h));
+            }
+            if (kind == langevin) {
+                c.langevin = true;
+                c.drift = 0.5*h;
+                c.friction = exp(-h/tau);
+                c.noise = sqrt((1 - c.friction*c.friction)*T0);
+            }
+        }
+
+        //energy of the chain variables (0 but for noseHoover), which with the energy of
+        //the particles and the work is conserved
+        double energy(int Nf) {
+            if (kind != noseHoover || vxi.empty()) return 0;
+            double E = Nf*T0*eta[0];
+            for (int k = 0; k < chain; k++) E += 0.5*Q[k]*vxi[k]*vxi[k];
+            for (int k = 1; k < chain; k++) E += T0*eta[k];
+            return E;
+        }
+
+    private:
+        //velocities, positions and masses of the chain
+        std::vector<double> vxi;
+        std::vector<double> eta;
+        std::vector<double> Q;
+
+        void rescale(Step &c, double &K, double s) {
+            c.scale *= s;
+            K *= s*s;
+        }
+
+        //moves the chain half a step (Martyna, Tuckerman & Klein), and returns the factor
+        //of the velocities
+        double chainHalfStep(double K, int Nf, double h) {
+            int M = chain;
+            if (vxi.size() != (size_t)M) {
+                vxi.assign(M, 0.0);
+                eta.assign(M, 0.0);
+                Q.assign(M, T0*tau*tau);
+                Q[0] = Nf*T0*tau*tau;
+            }
+            double dt = 0.5*h;
+            //force on chain element k
+            auto G = [&](int k) {
+                return (k == 0) ? (2*K - Nf*T0)/Q[0] : (Q[k-1]*vxi[k-1]*vxi[k-1] - T0)/Q[k];
+            };
+            vxi[M-1] += 0.5*dt*G(M-1);
+            for (int k = M-2; k >= 0; k--) {
+                double e = exp(-0.25*dt*vxi[k+1]);
+                vxi[k] = (vxi[k]*e + 0.5*dt*G(k))*e;
+            }
+            double s = exp(-dt*vxi[0]);
+            K *= s*s;
+            for (int k = 0; k < M; k++) eta[k] += dt*vxi[k];
+            for (int k = 0; k < M-1; k++) {
+                double e = exp(-0.25*dt*vxi[k+1]);
+                vxi[k] = (vxi[k]*e + 0.5*dt*G(k))*e;
+            }
+            vxi[M-1] += 0.5*dt*G(M-1);
+            return s;
+        }
+};
+
+class Barostat {
+    public:
+        //none: constant volume
+        //berendsen: the box and the positions are scaled every step so that the pressure
+        //relaxes to P0 with time constant tau (doesn't give the isobaric distribution)
+        //mttk: the isotropic Martyna-Tuckerman-Tobias-Klein equations, with a barostat of
+        //mass (N_f + D) T tau^2. the barostat itself isn't thermostatted
+        enum Kind {none, berendsen, mttk};
+        Kind kind = none;
+        double P0 = 1;
+        double tau = 1;
+        //isothermal compressibility, for berendsen
+        double compressibility = 1;
+
+        //start of a step of length h in D dimensions, with kinetic energy K (after the
+        //thermostat), virial and volume V, at temperature T (the target, if any). sets the
+        //coefficients of the positions, and of the velocities for mttk, and returns the
+        //factor by which the side of the box grows
+        double begin(Step &c, double K, double virial, double V, int D, int Nf, double h, double T) {
+            if (kind == berendsen) {
+                double P = (2*K + virial)/(D*V);
+                double mu = pow(std::max(0.0, 1 - compressibility*h/tau*(P0 - P)), 1.0/D);
+                c.grow = c.langevin ? sqrt(mu) : mu;
+                return mu;
+            }
+            if (kind == mttk) {
+                if (W == 0) W = (Nf + D)*T*tau*tau;
+                halfStep(K, virial, V, D, Nf, h);
+                double rate = pEps/W;
+                double e = exp(-0.25*(1 + (double)D/Nf)*rate*h);
+                c.scale *= e*e;
+                c.kick *= e;
+                c.scale2 *= e*e;
+                c.kick2 *= e;
+                double t = c.drift;
+                c.grow = exp(rate*t);
+                c.drift = t*exp(0.5*rate*t)*sinhc(0.5*rate*t);
+                return exp(rate*h);
+            }
+            return 1;
+        }
+
+        //end of the step, with the kinetic energy, virial and volume after it
+        void end(double K, double virial, double V, int D, int Nf, double h) {
+            if (kind == mttk) halfStep(K, virial, V, D, Nf, h);
+        }
+
+        //energy of the barostat and of the work against P0 (0 but for mttk), which with
+        //the energy of the particles is conserved
+        double energy(double V) {
+            if (kind != mttk) return 0;
+            return ((W > 0) ? 0.5*pEps*pEps/W : 0) + P0*V;
+        }
+
+    private:
+        //momentum and mass of the barostat
+        double pEps = 0;
+        double W = 0;
+
+        //dp/dt = D V (P - P0) + (D/Nf) 2K
+        void halfStep(double K, double virial, double V, int D, int Nf, double h) {
+            pEps += 0.5*h*((2*K + virial) - D*V*P0 + (double)D/Nf*2*K);
+        }
+};
+
+#endif
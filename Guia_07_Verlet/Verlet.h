@@ -0,0 +1,966 @@
+//Lennard-Jones atoms in a box, integrated with the velocity Verlet algorithm
+//(kick-drift-kick), at constant energy or coupled to the thermostats and barostats of
+//Thermostats.h. shared by verlet.cpp (simulation) and bench.cpp (benchmarks)
+//
+//Atoms<D, Boundary> is templated on the dimension D of the box and on its boundary:
+//Reflecting walls, or Periodic boundaries with the minimum image convention. both are
+//fixed at compile time, so the loops over the particles have no branches on them
+//Grid is the original 2D box with reflecting walls
+//
+//the potential is truncated at a cutoff rc and shifted so that it is continuous there:
+//  U(r) = 4 (r^-12 - r^-6) - U_rc   for r < rc, and 0 beyond
+//the pairs closer than rc + skin are kept in a neighbor list, built with a cell list
+//in O(N) and reused until a particle has moved more than skin/2, so that a step costs
+//O(N) instead of O(N^2). a cutoff of 0 keeps the original all pairs interaction
+//the particles are stored as a structure of arrays (x[d][i], v[d][i]...), which the
+//vectorized pair kernel of LJKernel.h loads a few particles at a time. the kernel also
+//sums the potential energy and the virial of the pairs it visits, so E_pot() and
+//pressure() cost nothing beyond the force evaluation of the step
+//
+//the temperature and pressure are held by the stages thermostat and barostat, which
+//only set the coefficients of the two passes over the particles of a step (see
+//Thermostats.h), so they cost about nothing. the second pass also sums the kinetic
+//energy, which the stages need at the start of the next step
+//
+//with more than one thread (see setThreads), the particles are moved, the neighbor
+//list searched and the forces computed by a ThreadPool. every thread adds the forces
+//of its share of the pairs to its own accelerations, which are then summed in a fixed
+//order, so a run gives the same result every time with the same number of threads. in
+//deterministic mode every particle sums the forces of all its neighbors instead (each
+//pair is evaluated twice, without Newton's third law), which gives the same result
+//with any number of threads. the Langevin noise is a hash of the seed, the step and the
+//particle, so it doesn't depend on the threads either
+//
+//the timestep can also be split (see setRespa): the short range part of the forces is
+//integrated in a few inner steps, and the smooth long range part, of the many far pairs,
+//once per step. and h can adapt to the fastest particle every step (see setAdaptive)
+
+#ifndef VERLET_H
+#define VERLET_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+#include "LJKernel.h"
+#include "Thermostats.h"
+#include "../Common/Profiler.h"
+#include "../Common/ThreadPool.h"
+#include "../Common/Random.h"
+
+//walls at 0 and L along every axis, that reflect the particles elastically
+class Reflecting {
+    public:
+        static const bool periodic = false;
+        double L;
+        void setSide(double L_) {
+            L = L_;
+        }
+        //difference of two coordinates: the walls don't change it
+        template <class T>
+        T image(T d) const {
+            return d;
+        }
+        //brings a coordinate that went through a wall (by less than L) back into the box,
+        //reversing its velocity. selects, not branches, so the loop is vectorized
+        void wrap(double &x, double &v) const {
+            bool low = x < 0;
+            x = low ? -x : x;
+            bool high = x > L;
+            x = high ? 2*L - x : x;
+            v = (low != high) ? -v : v;
+        }
+};
+
+//the box repeats itself along every axis: a particle leaving it comes back in at the
+//other side, and every particle interacts with the nearest image of each other one
+//(so the cutoff plus the skin must be at most L/2)
+class Periodic {
+    public:
+        static const bool periodic = true;
+        double L;
+        void setSide(double L_) {
+            L = L_;
+            invL = 1/L_;
+        }
+        //difference of two coordinates, to the nearest image: in [-L/2, L/2]
+        template <class T>
+        T image(T d) const {
+            return d - T(L)*nearest(d*T(invL));
+        }
+        //brings a coordinate back into [0, L). the velocity is left as it is: going through
+        //a periodic boundary doesn't change it
+        void wrap(double &x, double &) const {
+            x -= L*std::floor(x*invL);
+        }
+    private:
+        double invL;
+};
+
+template <int D, class Boundary>
+class Atoms {
+    public:
+        double density;
+        int N;    //number of particles
+        double L; //side length
+        double h;
+        double rc;   //cutoff of the potential (0: no cutoff)
+        double skin; //extra distance kept in the neighbor list
+        //positions, velocities and accelerations: x[d][i] is the coordinate of particle i
+        //along axis d
+        std::vector<double> x[D];
+        std::vector<double> v[D];
+        std::vector<double> a[D];
+        //number of times the neighbor list was built, of steps done, and the time they
+        //took (steps h with a fixed timestep)
+        long long rebuilds = 0;
+        long long steps = 0;
+        double time = 0;
+        //constant energy by default. set their kind, targets and times before the run
+        Thermostat thermostat;
+        Barostat barostat;
+
+        //N_c^D particles on a cubic lattice, at the given density, the velocity along the
+        //first axis +-1.1 at random (drawn with seed) and 0 along the others, as requested
+        //in "guia 6". with reflecting walls the lattice leaves a spacing free at every wall,
+        //with periodic boundaries half of it
+        //nThreads and deterministic are passed to setThreads, before the initial forces.
+        //verbose prints the parameters of the box
+        Atoms(int N_c, double h_, double density_, double rc_ = 2.5, double skin_ = 0.3,
+              int nThreads = 1, bool deterministic = false, uint64_t seed = 1, bool verbose = true) {
+            density = density_;
+            N = 1;
+            for (int d = 0; d < D; d++) N *= N_c;
+            h = h_;
+            rc = rc_;
+            skin = skin_;
+            L = pow(N/density, 1.0/D);
+            boundary.setSide(L);
+            double spacing = Boundary::periodic ? L/N_c : L/(N_c + 1);
+            double offset = Boundary::periodic ? 0.5 : 0.0;
+            double v_0[2] {-1.1, 1.1};
+            Random random(seed);
+            for (int i = 0; i < N; i++) {
+                //the first axis varies slowest
+                for (int d = 0; d < D; d++) {
+                    x[d].push_back((digit(i, N_c, D-1-d) + 1 - offset)*spacing);
+                    v[d].push_back((d == 0) ? v_0[random.next() >> 63] : 0.0);
+                }
+            }
+            for (int d = 0; d < D; d++) a[d].assign(N, 0.0);
+            kinetic = sumKinetic();
+            U_rc = (rc > 0) ? ljPotential(rc*rc) : 0.0;
+            setThreads(nThreads, deterministic);
+            //initial accelerations
+            accelerations();
+            if (!verbose) return;
+            std::string sides = std::to_string(N_c);
+            for (int d = 1; d < D; d++) sides += "x" + std::to_string(N_c);
+            std::cout << "\nGrid has been initialized. Info:\n";
+            std::cout << " - Number of particles N = " << sides << " = " << N << "\n";
+            std::cout << " - Density           rho = " << density << "\n";
+            std::cout << " - Side of box length  L = " << L << "\n";
+            std::cout << " - Boundaries            = " << D << "D, "
+                      << (Boundary::periodic ? "periodic" : "reflecting walls") << "\n";
+            std::cout << " - Timestep            h = " << h << "\n";
+            if (rc > 0) std::cout << " - Cutoff, skin          = " << rc << ", " << skin << "\n";
+            else std::cout << " - Cutoff                = none (all pairs)\n";
+            if (threads() > 1 || rowMode) {
+                std::cout << " - Threads               = " << threads()
+                          << (rowMode ? " (deterministic)" : "") << "\n";
+            }
+            if (Boundary::periodic && 2*(rc + skin) > L) {
+                std::cout << " - Warning: the cutoff plus the skin is more than L/2\n";
+            }
+            std::cout << "\nStarting simulation...\n\n";
+        }
+
+        //times the "integrate" (items: particles), "force" (items: pairs evaluated) and
+        //"neighbors" (items: pairs listed) phases of every updateParticles() in profiler.
+        //NULL stops it
+        void setProfiler(Profiler *profiler_) {
+            profiler = profiler_;
+            if (profiler) {
+                integratePhase = profiler->phase("integrate");
+                forcePhase = profiler->phase("force");
+                neighborPhase = profiler->phase("neighbors");
+            }
+        }
+
+        //runs the steps on nThreads threads (1: on the calling thread only). deterministic
+        //makes the forces, and so the whole run, independent of the number of threads, at
+        //the cost of evaluating every pair twice
+        void setThreads(int nThreads, bool deterministic = false) {
+            if (nThreads > 1) pool.reset(new ThreadPool(nThreads));
+            else pool.reset();
+            rowMode = deterministic;
+            if (rowMode && rc > 0) buildRows();
+        }
+
+        int threads() {
+            return pool ? pool->size() : 1;
+        }
+
+        //velocities drawn from the Maxwell-Boltzmann distribution at temperature T, with
+        //the Random seeded with seed, then without the motion of the center of mass and
+        //scaled to exactly T
+        void setTemperature(double T, uint64_t seed) {
+            Random random(seed);
+            const double pi = 3.14159265358979323846;
+            for (int d = 0; d < D; d++) {
+                //Box-Muller, two velocities at a time
+                for (int i = 0; i < N; i += 2) {
+                    double r = sqrt(-2*log(1 - random.uniform())), phi = 2*pi*random.uniform();
+                    v[d][i] = r*cos(phi);
+                    if (i+1 < N) v[d][i+1] = r*sin(phi);
+                }
+                double mean = 0;
+                for (int i = 0; i < N; i++) mean += v[d][i];
+                mean /= N;
+                for (int i = 0; i < N; i++) v[d][i] -= mean;
+            }
+            double K = sumKinetic();
+            double s = (K > 0) ? sqrt(0.5*D*N*T/K) : 0;
+            for (int d = 0; d < D; d++) {
+                for (int i = 0; i < N; i++) v[d][i] *= s;
+            }
+            kinetic = sumKinetic();
+        }
+
+        //multiple time stepping (RESPA: Tuckerman, Berne & Martyna, 1992): the potential is
+        //split between r1 and r2 (see ljSplit), and every step of length h moves the
+        //particles in inner substeps of h/inner with the short range forces, of the pairs
+        //closer than r2 + innerSkin only, while the long range forces of the whole list
+        //kick them only at the start and the end of the step. inner = 0 goes back to plain
+        //velocity Verlet. needs r2 + innerSkin <= rc, and works with the thermostats that
+        //only scale the velocities (Berendsen, Nose-Hoover), but not with Langevin, a
+        //barostat or deterministic mode. false (and nothing changed) if it can't be used
+        bool setRespa(int inner, double r1 = 1.5, double r2 = 1.8, double innerSkin_ = 0.3) {
+            if (inner <= 0) {
+                if (respa) {
+                    respa = 0;
+                    accelerations();
+                }
+                return true;
+            }
+            if (rc <= 0 || rowMode || r1 >= r2 || r2 + innerSkin_ > rc ||
+                thermostat.kind == Thermostat::langevin || barostat.kind != Barostat::none) {
+                std::cout << " - Multiple time stepping needs r1 < r2, r2 + skin <= rc, and no "
+                          << "deterministic mode, Langevin thermostat or barostat\n";
+                return false;
+            }
+            respa = inner;
+            split.r1sq = r1*r1;
+            split.invWidth = 1/(r2*r2 - r1*r1);
+            innerSkin = innerSkin_;
+            innerReach = r2 + innerSkin;
+            for (int d = 0; d < D; d++) aLong[d].assign(N, 0.0);
+            buildNeighbors();
+            shortForces();
+            longForces();
+            return true;
+        }
+
+        //adaptive timestep: after every step h is set so that no coordinate would move
+        //more than about maxMove_ in the next one, h = min(hMax_, maxMove_/|v|, sqrt(2 maxMove_/|a|))
+        //with the largest velocity and acceleration components. hMax_ = 0 keeps h fixed
+        void setAdaptive(double hMax_, double maxMove_) {
+            adaptive = hMax_ > 0;
+            hMax = hMax_;
+            maxMove = maxMove_;
+        }
+
+        void updateParticles() {
+            if (respa) {
+                respaStep();
+                return;
+            }
+            integrate();
+            forces();
+        }
+
+        //first pass of the step: half a kick and the drift of the positions (with the
+        //Langevin kick in the middle), as set by the thermostat and the barostat
+        void integrate() {
+            Profiler::Timer timer(profiler, integratePhase, N);
+            int Nf = D*N;
+            step = Step(h);
+            double K = kinetic;
+            thermostat.begin(step, K, Nf, h);
+            double T = (thermostat.kind != Thermostat::none) ? thermostat.T0 : 2*K/Nf;
+            double grow = barostat.begin(step, K, virial, volume(), D, Nf, h, T);
+            if (grow != 1) {
+                //the box grows with the positions, and the neighbor list with it
+                L *= grow;
+                density = N/volume();
+                boundary.setSide(L);
+                listScale *= grow;
+            }
+            int nThreads = threads();
+            threadK.assign(nThreads, 0.0);
+            if (step.langevin) forThreads([this](int t) { drift<true>(t); });
+            else forThreads([this](int t) { drift<false>(t); });
+            //energy given to the particles by the Langevin kicks
+            for (int t = 0; t < nThreads; t++) thermostat.work -= threadK[t];
+            steps++;
+            time += h;
+        }
+
+        //forces at the new positions, then the second pass: the other half kick, summing
+        //the kinetic energy
+        void forces() {
+            accelerations();
+            double aMax = kick(a, step.scale2, step.kick2);
+            barostat.end(kinetic, virial, volume(), D, D*N, h);
+            if (adaptive) adapt(aMax);
+        }
+
+        //returns cinetic energy, as summed by the last step
+        double E_cin() {
+            return kinetic;
+        }
+
+        //return potential energy, as summed by the last force evaluation (the positions
+        //don't change between it and the end of a step)
+        double E_pot() {
+            return potential;
+        }
+
+        //returns total energy
+        double E_tot() {
+            return E_cin()+E_pot();
+        }
+
+        //temperature (k_B = 1), from equipartition: E_cin = (D/2) N T
+        double temperature() {
+            return 2*E_cin()/(D*N);
+        }
+
+        //L^D
+        double volume() {
+            double V = 1;
+            for (int d = 0; d < D; d++) V *= L;
+            return V;
+        }
+
+        //pressure from the virial theorem: P V = N T + (1/D) sum over pairs of r.F
+        //the walls' contribution, if any, is left out
+        double pressure() {
+            return (2*E_cin() + virial)/(D*volume());
+        }
+
+        //the energy of the particles plus that of the thermostat and barostat variables and
+        //the work they did, which the equations of motion conserve (but for the Berendsen
+        //stages, which don't conserve anything)
+        double conserved() {
+            return E_tot() + thermostat.work + thermostat.energy(D*N) + barostat.energy(volume());
+        }
+
+        //makes the next force evaluation also count its pairs by distance, in bins of
+        //width rMax/counts.size() up to rMax (at most rc, as the neighbor list only has
+        //every pair closer than that), adding them to counts (see Analysis.h)
+        void countPairs(std::vector<long long> *counts, double rMax) {
+            pairCounts = counts;
+            countRange = (rc > 0) ? std::min(rMax, rc) : rMax;
+        }
+
+        //sets the accelerations, potential energy and virial from the current positions,
+        //rebuilding the neighbor list first if needed. every pair is evaluated once, and its
+        //force added to both particles (Newton's third law)
+        void accelerations() {
+            if (rc > 0 && (rebuilds == 0 || listScale*(rc + skin) - 2*maxDisplacement() < rc)) {
+                buildNeighbors();
+            }
+            Profiler::Timer timer(profiler, forcePhase, rowMode ? 2*pairs() : pairs());
+            //the pairs are counted by the list kernel, or else by a pass of their own
+            std::vector<long long> *counts = pairCounts;
+            pairCounts = NULL;
+            if (rowMode || rc <= 0) {
+                if (rowMode) rowForces();
+                if (counts) countAllPairs(*counts);
+                if (rowMode) return;
+                counts = NULL;
+            }
+            listForces<0>(a, potential, virial, counts);
+        }
+
+        //number of pairs in the neighbor list (N(N-1)/2 without cutoff)
+        long long pairs() {
+            if (rc <= 0) return (long long)N*(N-1)/2;
+            return pairI.size();
+        }
+
+        ~Atoms() {}
+
+    private:
+        Boundary boundary;
+        Profiler *profiler = NULL;
+        int integratePhase;
+        int forcePhase;
+        int neighborPhase;
+        //value of the potential at the cutoff, subtracted so that it goes to 0 there
+        double U_rc;
+        //potential energy and virial (sum over pairs of r.F) of the current positions
+        double potential = 0;
+        double virial = 0;
+        //kinetic energy of the current velocities, and the coefficients of this step
+        double kinetic = 0;
+        Step step = Step(0);
+        //adaptive timestep (see setAdaptive), and the largest velocity and acceleration
+        //components of each thread in the last step
+        bool adaptive = false;
+        double hMax;
+        double maxMove;
+        double vMax = 0;
+        std::vector<double> threadVMax;
+        std::vector<double> threadAMax;
+        //multiple time stepping (see setRespa): the long range accelerations, the
+        //potential energy and virial of both parts, and the inner list (the pairs closer
+        //than the end of the switch plus innerSkin) with the positions it was made at
+        int respa = 0;
+        Split split;
+        double innerReach = 0;
+        double innerSkin = 0;
+        std::vector<double> aLong[D];
+        double shortU = 0;
+        double shortW = 0;
+        double longU = 0;
+        double longW = 0;
+        std::vector<int> innerI;
+        std::vector<int> innerJ;
+        std::vector<double> xInner[D];
+        //parallel engine, see setThreads(). threadA[t*D + d], threadU[t] and threadW[t]
+        //hold the part of thread t, and threadI[t], threadJ[t] the pairs it found in the
+        //last neighbor search (threadInnerI[t], threadInnerJ[t] those of the inner list)
+        std::unique_ptr<ThreadPool> pool;
+        bool rowMode = false;
+        std::vector<std::vector<double>> threadA;
+        std::vector<double> threadU;
+        std::vector<double> threadW;
+        std::vector<double> threadK;
+        std::vector<std::vector<int>> threadI;
+        std::vector<std::vector<int>> threadJ;
+        std::vector<std::vector<int>> threadInnerI;
+        std::vector<std::vector<int>> threadInnerJ;
+        //deterministic mode: the neighbors of particle i are
+        //neighbors[neighborStart[i]] to neighbors[neighborStart[i+1]-1], and rowU[i],
+        //rowW[i] the energy and virial of its pairs
+        std::vector<int> neighborStart;
+        std::vector<int> neighbors;
+        std::vector<double> rowU;
+        std::vector<double> rowW;
+        //neighbor list: the pairs (pairI[k], pairJ[k]) of particles closer than rc + skin
+        //when it was built, each once, sorted by pairI
+        std::vector<int> pairI;
+        std::vector<int> pairJ;
+        //positions at the time the list was built, and the factor by which the box has
+        //grown since then
+        std::vector<double> x0[D];
+        double listScale = 1;
+        //pairs to count by the next force evaluation (see countPairs), and each thread's
+        std::vector<long long> *pairCounts = NULL;
+        double countRange = 0;
+        std::vector<std::vector<long long>> threadCounts;
+        //cell list: the particles of cell c are sorted[cellStart[c]] to
+        //sorted[cellStart[c+1]-1], and sortedX[d] their coordinates, in that order.
+        //stencil[c*S + k] (S = (3^D + 1)/2) are c and the cells around it that come after
+        //it, or -1 past a wall
+        std::vector<int> cellStart;
+        std::vector<int> sorted;
+        std::vector<double> sortedX[D];
+        std::vector<int> stencil;
+
+        //digit d of n in base base
+        static int digit(int n, int base, int d) {
+            for (int e = 0; e < d; e++) n /= base;
+            return n % base;
+        }
+
+        //the D arrays of u, as the kernels take them
+        static std::array<double*, D> pointers(std::vector<double> (&u)[D]) {
+            std::array<double*, D> p;
+            for (int d = 0; d < D; d++) p[d] = &u[d][0];
+            return p;
+        }
+
+        //runs job(0), ..., job(T-1) on the T threads, or job(0) on the calling one
+        template <class Job>
+        void forThreads(Job job) {
+            if (!pool) {
+                job(0);
+                return;
+            }
+            for (int t = 0; t < pool->size(); t++) pool->submit([&job, t] { job(t); });
+            pool->wait();
+        }
+
+        //start of the part t of n items split in threads() equal parts (share(n, T) = n)
+        int share(long long n, int t) {
+            return n*t/threads();
+        }
+
+        //the forces of part (see ljSplit) of the pairs of the list (the inner list for
+        //part 1) to acc, their energy to U and virial to W, and with counts, their
+        //distances as countPairs does
+        template <int part>
+        void listForces(std::vector<double> (&acc)[D], double &U, double &W,
+                        std::vector<long long> *counts = NULL) {
+            int T = threads();
+            if (T == 1) {
+                if (!counts) pairForces<part>(0, pointers(acc).data(), U, W);
+                else pairForces<part>(0, pointers(acc).data(), U, W, &(*counts)[0], counts->size());
+                return;
+            }
+            threadA.resize(T*D);
+            threadU.assign(T, 0.0);
+            threadW.assign(T, 0.0);
+            threadCounts.resize(T);
+            forThreads([this, counts](int t) {
+                double *at[D];
+                for (int d = 0; d < D; d++) {
+                    threadA[t*D + d].resize(N);
+                    at[d] = &threadA[t*D + d][0];
+                }
+                long long *histogram = NULL;
+                if (counts) {
+                    threadCounts[t].assign(counts->size(), 0);
+                    histogram = &threadCounts[t][0];
+                }
+                pairForces<part>(t, at, threadU[t], threadW[t], histogram, histogram ? counts->size() : 0);
+            });
+            if (counts) {
+                for (int t = 0; t < T; t++) {
+                    for (size_t b = 0; b < counts->size(); b++) (*counts)[b] += threadCounts[t][b];
+                }
+            }
+            //sum of the threads' accelerations, always in the order of the threads
+            forThreads([this, T, &acc](int t) {
+                for (int d = 0; d < D; d++) {
+                    for (int i = share(N, t); i < share(N, t+1); i++) {
+                        double s = 0;
+                        for (int k = 0; k < T; k++) s += threadA[k*D + d][i];
+                        acc[d][i] = s;
+                    }
+                }
+            });
+            U = 0;
+            W = 0;
+            for (int t = 0; t < T; t++) {
+                U += threadU[t];
+                W += threadW[t];
+            }
+        }
+
+        //adds the forces of the part t of the pairs to a_ (set to 0 first), and their
+        //energy and virial to energy, virial_ (also set to 0). with a histogram, the
+        //listed pairs are also counted in it (see countPairs). part as in listForces
+        template <int part>
+        void pairForces(int t, double *const *a_, double &energy, double &virial_,
+                        long long *histogram = NULL, int bins = 0) {
+            for (int d = 0; d < D; d++) std::fill(a_[d], a_[d] + N, 0.0);
+            energy = 0;
+            virial_ = 0;
+            std::array<double*, D> x_ = pointers(x);
+            if (rc <= 0) {
+                //the rows get shorter with i, so they are dealt out in turn to balance them
+                double all = std::numeric_limits<double>::infinity();
+                for (int i = t; i < N; i += threads()) {
+                    ljRow<D>(i, i+1, N-i-1, x_.data(), a_, boundary, all, 0.0, energy, virial_);
+                }
+                return;
+            }
+            const std::vector<int> &I = (part == 1) ? innerI : pairI, &J = (part == 1) ? innerJ : pairJ;
+            int begin = share(I.size(), t), end = share(I.size(), t+1);
+            ljPairList<D, part>(I.data() + begin, J.data() + begin, end - begin, x_.data(), a_,
+                                boundary, rc*rc, U_rc, energy, virial_, histogram, bins,
+                                histogram ? bins/countRange : 0.0, split);
+        }
+
+        //counts the pairs for countPairs where the force kernels don't: the listed ones in
+        //deterministic mode, or all of them without cutoff
+        void countAllPairs(std::vector<long long> &counts) {
+            int bins = counts.size();
+            double binsPerUnit = bins/countRange;
+            auto count = [&](int i, int j) {
+                double r2 = 0;
+                for (int d = 0; d < D; d++) {
+                    double dx = boundary.image(x[d][i] - x[d][j]);
+                    r2 += dx*dx;
+                }
+                int bin = (int)(sqrt(r2)*binsPerUnit);
+                if (bin < bins) counts[bin]++;
+            };
+            if (rc > 0) {
+                for (size_t k = 0; k < pairI.size(); k++) count(pairI[k], pairJ[k]);
+            }
+            else {
+                for (int i = 0; i < N; i++) {
+                    for (int j = i+1; j < N; j++) count(i, j);
+                }
+            }
+        }
+
+        //deterministic mode: every particle sums the forces of all its neighbors, and the
+        //energy and virial are summed over the particles in order (each pair counted twice)
+        void rowForces() {
+            rowU.resize(N);
+            rowW.resize(N);
+            forThreads([this](int t) {
+                std::array<double*, D> x_ = pointers(x);
+                for (int i = share(N, t); i < share(N, t+1); i++) {
+                    double f[D] = {}, u = 0, w = 0;
+                    if (rc <= 0) {
+                        double all = std::numeric_limits<double>::infinity();
+                        ljSum<D>(i, NULL, 0, i, x_.data(), boundary, all, 0.0, f, u, w);
+                        ljSum<D>(i, NULL, i+1, N-i-1, x_.data(), boundary, all, 0.0, f, u, w);
+                    }
+                    else {
+                        int first = neighborStart[i];
+                        ljSum<D>(i, &neighbors[first], 0, neighborStart[i+1] - first, x_.data(),
+                                 boundary, rc*rc, U_rc, f, u, w);
+                    }
+                    for (int d = 0; d < D; d++) a[d][i] = f[d];
+                    rowU[i] = u;
+                    rowW[i] = w;
+                }
+            });
+            potential = 0;
+            virial = 0;
+            for (int i = 0; i < N; i++) {
+                potential += rowU[i];
+                virial += rowW[i];
+            }
+            potential *= 0.5;
+            virial *= 0.5;
+        }
+
+        //largest distance moved by a particle since the neighbor list was built, on top of
+        //the scaling of the box. while the pairs beyond rc + skin, scaled, can't have come
+        //within rc of each other by it, the list still has every pair that interacts
+        double maxDisplacement() {
+            return maxDisplacement(x0, listScale);
+        }
+
+        //the same since the positions from, scaled by scale
+        double maxDisplacement(const std::vector<double> (&from)[D], double scale) {
+            double max2 = 0;
+            for (int i = 0; i < N; i++) {
+                double r2 = 0;
+                for (int d = 0; d < D; d++) {
+                    double dx = boundary.image(x[d][i] - scale*from[d][i]);
+                    r2 += dx*dx;
+                }
+                max2 = std::max(max2, r2);
+            }
+            return sqrt(max2);
+        }
+
+        //the lists of the threads, one after the other, into list
+        static void join(std::vector<std::vector<int>> &parts, std::vector<int> &list) {
+            if (parts.size() == 1) {
+                list.swap(parts[0]);
+                return;
+            }
+            list.clear();
+            for (size_t t = 0; t < parts.size(); t++) list.insert(list.end(), parts[t].begin(), parts[t].end());
+        }
+
+        //bins the particles in cubic cells of side at least rc + skin, so that the
+        //neighbors of a particle are in its cell or in the 3^D - 1 around it. every pair of
+        //cells is searched once: a cell is paired with itself and with the half of the
+        //cells around it that come after it
+        void buildNeighbors() {
+            Profiler::Timer timer(profiler, neighborPhase);
+            double reach = rc + skin;
+            int nCells = std::max(1, (int)(L/reach));
+            //with periodic boundaries the 3 cells around a cell along an axis must be
+            //different ones
+            if (Boundary::periodic && nCells < 3) nCells = 1;
+            double cellSize = L/nCells;
+            int cells = 1, around = 1;
+            for (int d = 0; d < D; d++) {
+                cells *= nCells;
+                around *= 3;
+            }
+            //counting sort of the particles by cell. the boundaries keep them in [0, L],
+            //and the first axis varies fastest in the cell index
+            std::vector<int> cell(N);
+            cellStart.assign(cells+1, 0);
+            for (int i = 0; i < N; i++) {
+                int c = 0;
+                for (int d = D-1; d >= 0; d--) {
+                    c = c*nCells + std::min(nCells-1, std::max(0, (int)(x[d][i]/cellSize)));
+                }
+                cell[i] = c;
+                cellStart[c+1]++;
+            }
+            for (int c = 0; c < cells; c++) cellStart[c+1] += cellStart[c];
+            sorted.resize(N);
+            std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+            for (int i = 0; i < N; i++) sorted[fill[cell[i]]++] = i;
+            for (int d = 0; d < D; d++) {
+                sortedX[d].resize(N);
+                for (int k = 0; k < N; k++) sortedX[d][k] = x[d][sorted[k]];
+            }
+            //the cell at offset (k_0 - 1, k_1 - 1, ...) from c, with k_d the digits of k in
+            //base 3. k = (3^D - 1)/2 is c itself, and the larger k the cells after it
+            int half = (around + 1)/2;
+            stencil.resize(cells*half);
+            for (int c = 0; c < cells; c++) {
+                for (int k = around/2; k < around; k++) {
+                    int n = 0;
+                    for (int d = D-1; d >= 0 && n >= 0; d--) {
+                        int offset = digit(k, 3, d) - 1;
+                        int cd = digit(c, nCells, d) + offset;
+                        if (Boundary::periodic) {
+                            cd = (nCells == 1 && offset != 0) ? -1 : (cd + nCells) % nCells;
+                        }
+                        n = (cd < 0 || cd >= nCells) ? -1 : n*nCells + cd;
+                    }
+                    stencil[c*half + k - around/2] = n;
+                }
+            }
+            double reach2 = reach*reach;
+            //with multiple time stepping, the pairs closer than innerReach also go to the
+            //inner list
+            double inner2 = respa ? innerReach*innerReach : -1;
+            //every thread searches the pairs of a range of i, and the ranges are joined in
+            //order, so the list is the same with any number of threads
+            int T = threads();
+            threadI.resize(T);
+            threadJ.resize(T);
+            threadInnerI.resize(T);
+            threadInnerJ.resize(T);
+            forThreads([&](int t) {
+                std::vector<int> &I = threadI[t], &J = threadJ[t];
+                std::vector<int> &innerI_ = threadInnerI[t], &innerJ_ = threadInnerJ[t];
+                I.clear();
+                J.clear();
+                innerI_.clear();
+                innerJ_.clear();
+                for (int i = share(N, t); i < share(N, t+1); i++) {
+                    double xi[D];
+                    for (int d = 0; d < D; d++) xi[d] = x[d][i];
+                    const int *s = &stencil[cell[i]*half];
+                    for (int k = 0; k < half; k++) {
+                        if (s[k] < 0) continue;
+                        for (int m = cellStart[s[k]]; m < cellStart[s[k]+1]; m++) {
+                            double dx = boundary.image(xi[0] - sortedX[0][m]);
+                            double r2 = dx*dx;
+                            for (int d = 1; d < D; d++) {
+                                dx = boundary.image(xi[d] - sortedX[d][m]);
+                                r2 += dx*dx;
+                            }
+                            //in its own cell (k = 0), every pair is seen from both particles
+                            if (r2 < reach2 && (k > 0 || sorted[m] > i)) {
+                                I.push_back(i);
+                                J.push_back(sorted[m]);
+                                if (r2 < inner2) {
+                                    innerI_.push_back(i);
+                                    innerJ_.push_back(sorted[m]);
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+            join(threadI, pairI);
+            join(threadJ, pairJ);
+            join(threadInnerI, innerI);
+            join(threadInnerJ, innerJ);
+            if (rowMode) buildRows();
+            for (int d = 0; d < D; d++) x0[d] = x[d];
+            if (respa) {
+                for (int d = 0; d < D; d++) xInner[d] = x[d];
+            }
+            listScale = 1;
+            rebuilds++;
+            timer.addItems(pairI.size());
+        }
+
+        //first pass of the step over part t of the particles (see integrate), adding the
+        //energy given by the Langevin kicks to threadK[t]
+        template <bool langevin>
+        void drift(int t) {
+            const Step c = step;
+            double given = 0;
+            for (int d = 0; d < D; d++) {
+                double *x_ = &x[d][0], *v_ = &v[d][0];
+                const double *a_ = &a[d][0];
+                for (int i = share(N, t); i < share(N, t+1); i++) {
+                    double vi = c.scale*v_[i] + c.kick*a_[i];
+                    double xi = c.grow*x_[i] + c.drift*vi;
+                    if (langevin) {
+                        //Gaussian noise of unit variance, by Box-Muller on two words of a hash
+                        //of the step and particle
+                        uint64_t z = thermostat.noiseKey ^ ((uint64_t)(d*N + i) << 32 | (uint32_t)steps);
+                        double u1 = Random::toUniform(Random::splitmix64(z));
+                        double u2 = Random::toUniform(Random::splitmix64(z));
+                        double noise = sqrt(-2*log(1 - u1))*cos(6.283185307179586*u2);
+                        double vn = c.friction*vi + c.noise*noise;
+                        given += 0.5*(vn*vn - vi*vi);
+                        vi = vn;
+                        xi = c.grow*xi + c.drift*vi;
+                    }
+                    //bring it back if it left the box
+                    boundary.wrap(xi, vi);
+                    x_[i] = xi;
+                    v_[i] = vi;
+                }
+            }
+            threadK[t] = given;
+        }
+
+        //v = scale v + dt acc, summing the kinetic energy. returns the largest component
+        //of acc, and leaves that of v in vMax
+        double kick(std::vector<double> (&acc)[D], double scale, double dt) {
+            Profiler::Timer timer(profiler, integratePhase, N);
+            int nThreads = threads();
+            threadK.assign(nThreads, 0.0);
+            threadVMax.assign(nThreads, 0.0);
+            threadAMax.assign(nThreads, 0.0);
+            forThreads([this, &acc, scale, dt](int t) {
+                double v2 = 0, vm = 0, am = 0;
+                for (int d = 0; d < D; d++) {
+                    double *v_ = &v[d][0];
+                    const double *a_ = &acc[d][0];
+                    for (int i = share(N, t); i < share(N, t+1); i++) {
+                        v_[i] = scale*v_[i] + dt*a_[i];
+                        v2 += v_[i]*v_[i];
+                        vm = std::max(vm, std::fabs(v_[i]));
+                        am = std::max(am, std::fabs(a_[i]));
+                    }
+                }
+                threadK[t] = 0.5*v2;
+                threadVMax[t] = vm;
+                threadAMax[t] = am;
+            });
+            //in deterministic mode the sum mustn't depend on the split among the threads,
+            //as the thermostats use it
+            if (rowMode) kinetic = sumKinetic();
+            else {
+                kinetic = 0;
+                for (int t = 0; t < nThreads; t++) kinetic += threadK[t];
+            }
+            vMax = *std::max_element(threadVMax.begin(), threadVMax.end());
+            return *std::max_element(threadAMax.begin(), threadAMax.end());
+        }
+
+        //the timestep of the next step (see setAdaptive), from vMax and the largest
+        //acceleration component aMax
+        void adapt(double aMax) {
+            h = hMax;
+            if (vMax > 0) h = std::min(h, maxMove/vMax);
+            if (aMax > 0) h = std::min(h, sqrt(2*maxMove/aMax));
+        }
+
+        //a step of multiple time stepping (see setRespa)
+        void respaStep() {
+            step = Step(h);
+            double K = kinetic;
+            thermostat.begin(step, K, D*N, h);
+            double dt = h/respa;
+            //the long range half kick, then the inner steps, each a plain velocity Verlet
+            //step with the short range forces
+            kick(aLong, step.scale, 0.5*h);
+            double aMax = 0;
+            for (int s = 0; s < respa; s++) {
+                step = Step(dt);
+                step.kick = 0.5*dt;
+                {
+                    Profiler::Timer timer(profiler, integratePhase, N);
+                    threadK.assign(threads(), 0.0);
+                    forThreads([this](int t) { drift<false>(t); });
+                }
+                shortForces();
+                aMax = std::max(aMax, kick(a, 1, 0.5*dt));
+            }
+            longForces();
+            aMax = std::max(aMax, kick(aLong, 1, 0.5*h));
+            steps++;
+            time += h;
+            if (adaptive) adapt(aMax);
+        }
+
+        //the short range forces of the inner list, updating the lists first if needed
+        void shortForces() {
+            //built with the whole list, the inner one lasts as long if its skin is as wide
+            if (listScale*(rc + skin) - 2*maxDisplacement() < rc) buildNeighbors();
+            else if (innerSkin < skin && 2*maxDisplacement(xInner, 1) > innerSkin) filterInner();
+            Profiler::Timer timer(profiler, forcePhase, innerI.size());
+            listForces<1>(a, shortU, shortW);
+            potential = shortU + longU;
+            virial = shortW + longW;
+        }
+
+        //the long range forces of the whole list, which also counts the pairs for
+        //countPairs
+        void longForces() {
+            if (listScale*(rc + skin) - 2*maxDisplacement() < rc) buildNeighbors();
+            Profiler::Timer timer(profiler, forcePhase, pairs());
+            std::vector<long long> *counts = pairCounts;
+            pairCounts = NULL;
+            listForces<2>(aLong, longU, longW, counts);
+            potential = shortU + longU;
+            virial = shortW + longW;
+        }
+
+        //the inner list again from the whole one (see buildNeighbors): the pairs closer than
+        //innerReach. it has every pair closer than the end of the switch while no particle
+        //has moved innerSkin/2 since
+        void filterInner() {
+            Profiler::Timer timer(profiler, neighborPhase, pairI.size());
+            innerI.clear();
+            innerJ.clear();
+            double reach2 = innerReach*innerReach;
+            for (size_t k = 0; k < pairI.size(); k++) {
+                double r2 = 0;
+                for (int d = 0; d < D; d++) {
+                    double dx = boundary.image(x[d][pairI[k]] - x[d][pairJ[k]]);
+                    r2 += dx*dx;
+                }
+                if (r2 < reach2) {
+                    innerI.push_back(pairI[k]);
+                    innerJ.push_back(pairJ[k]);
+                }
+            }
+            for (int d = 0; d < D; d++) xInner[d] = x[d];
+        }
+
+        //kinetic energy of the current velocities, summed in the order of the particles
+        double sumKinetic() {
+            double E_k = 0.0;
+            for (int i = 0; i < N; i++) {
+                double v2 = v[0][i]*v[0][i];
+                for (int d = 1; d < D; d++) v2 += v[d][i]*v[d][i];
+                E_k += v2;
+            }
+            return 0.5*E_k;
+        }
+
+        //deterministic mode: the neighbors of every particle, from the pair list (the
+        //pairs where it is second first, then the ones where it is first)
+        void buildRows() {
+            neighborStart.assign(N+1, 0);
+            for (size_t k = 0; k < pairI.size(); k++) {
+                neighborStart[pairI[k]+1]++;
+                neighborStart[pairJ[k]+1]++;
+            }
+            for (int i = 0; i < N; i++) neighborStart[i+1] += neighborStart[i];
+            neighbors.resize(2*pairI.size());
+            std::vector<int> fill(neighborStart.begin(), neighborStart.end() - 1);
+            for (size_t k = 0; k < pairI.size(); k++) neighbors[fill[pairJ[k]]++] = pairI[k];
+            for (size_t k = 0; k < pairI.size(); k++) neighbors[fill[pairI[k]]++] = pairJ[k];
+        }
+};
+
+//the original simulation: a 2D box with reflecting walls
+typedef Atoms<2, Reflecting> Grid;
+
+#endif
@@ -0,0 +1,415 @@
+// Throughput benchmark of the Lennard-Jones simulator
+// "scaling" runs the neighbor list engine (cutoff 2.5, skin 0.3) at density 0.3 for
+// N = 900 to 10^6 particles, and the all pairs interaction for N = 900, and reports the
+// time per step and per particle-step: the neighbor list one stays constant with N
+// "kernel" compares the pair interactions per second of the original force loop (an
+// array of Particle objects, F() taking them by value and using pow) with the vector
+// kernel of LJKernel.h, for all pairs of N = 900 and for the neighbor list of N = 10^5
+// "threads" times the parallel engine on 1, 2, 4... up to max threads: strong scaling
+// with N = 10^5, weak scaling with 25000 particles per thread, and the potential energy
+// reached by the deterministic mode with every number of threads (all the same)
+// "dims" compares the engine in 2D and 3D, with reflecting walls and periodic boundaries,
+// at N = 10^5: the time per step, and the drift of the total energy over the steps
+// "ensembles" times the thermostats and barostats of Thermostats.h against the constant
+// energy run, at N = 10^5 in a periodic 2D box: the time per step, its overhead, and the
+// final temperature, pressure and change of the conserved quantity
+// "output" times N = 10^5 in a periodic 2D box saving a frame every 10 steps: written
+// on the simulation's thread, or handed to the background writer of Output.h (float32,
+// fixed point and XYZ), and the energies of every step flushed line by line (endl) or
+// logged in blocks
+// "timestep" runs the same simulated time of N = 10^5 in a periodic 2D box, a gas and a
+// liquid, with velocity Verlet at several timesteps, with multiple time stepping (RESPA,
+// 2 to 4 inner steps of the short range forces) and with the adaptive
+// timestep: the time per unit of simulated time, and the largest relative change of the
+// total energy, to compare the speed at equal drift
+// "replicas" runs many replicas of the 30 x 30 grid of verlet.cpp, one after the other as
+// separate runs, and packed in the runner of Replicas.h on 1 thread and on every core:
+// replica-steps per second
+// compilation: g++ -O3 -std=c++11 -march=native -pthread -o bench bench.cpp
+// usage: ./bench scaling [steps] (default 100)
+//        ./bench kernel [passes] (default 20)
+//        ./bench threads [steps] [max] (defaults 50, and the number of cores)
+//        ./bench dims [steps] (default 200)
+//        ./bench ensembles [steps] (default 200)
+//        ./bench output [steps] (default 100)
+//        ./bench timestep [time] (default 2)
+//        ./bench replicas [replicas] [steps] (defaults 32 and 500)
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <fstream>
+
+#include "Verlet.h"
+#include "Output.h"
+#include "Replicas.h"
+
+using namespace std;
+
+//the original implementation: particles as objects, and every pair evaluated twice
+class Particle {
+    public:
+        double x;
+        double y;
+        double vx;
+        double vy;
+        double ax = 0.0;
+        double ay = 0.0;
+        double prev_ax = 0.0;
+        double prev_ay = 0.0;
+        Particle(double x_, double y_, double vx_, double vy_) {
+            x = x_; y = y_; vx = vx_; vy = vy_;
+        }
+};
+
+void F(Particle a, Particle b, double &ax, double &ay) {
+    double r = pow(a.x - b.x, 2) + pow(a.y - b.y, 2);
+    double f = 24 * (2 * pow(r, -7) - pow(r, -4));
+    ax += (a.x - b.x) * f;
+    ay += (a.y - b.y) * f;
+}
+
+void legacyAccelerations(vector<Particle> &particles) {
+    int N = particles.size();
+    for (int i = 0; i < N; i++) {
+        double ax = 0;
+        double ay = 0;
+        for (int j = 0; j < N; j++) {
+            if (i != j) F(particles[i], particles[j], ax, ay);
+        }
+        particles[i].ax = ax;
+        particles[i].ay = ay;
+    }
+}
+
+//runs steps steps of a N_c x N_c grid, and prints the time they took
+void timeSteps(string name, int N_c, double rc, int steps) {
+    Grid g(N_c, 0.005, 0.3, rc, 0.3);
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) g.updateParticles();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << " " << name << " N = " << g.N << ": " << seconds/steps*1e3 << " ms/step, "
+         << seconds/steps/g.N*1e9 << " ns per particle-step (" << g.pairs() << " pairs, "
+         << g.rebuilds << " neighbor list builds)\n";
+}
+
+int scaling(int steps) {
+    cout << "\n" << steps << " steps, density 0.3\n";
+    timeSteps("all pairs     ", 30, 0, steps);
+    int sides[4] = {30, 100, 316, 1000};
+    for (int k = 0; k < 4; k++) timeSteps("neighbor list ", sides[k], 2.5, steps);
+    return 0;
+}
+
+int kernel(int passes) {
+    const char *isa = (Vec::width == 8) ? "AVX-512" : (Vec::width == 4) ? "AVX2" : "scalar";
+    cout << "\nvector kernel: " << Vec::width << " doubles per operation (" << isa << "), "
+         << passes << " force passes\n";
+    Grid g(30, 0.005, 0.3, 0, 0.3);
+    vector<Particle> particles;
+    for (int i = 0; i < g.N; i++) particles.push_back(Particle(g.x[0][i], g.x[1][i], g.v[0][i], g.v[1][i]));
+    double pairs = (double)g.N*(g.N-1)/2;
+
+    auto start = chrono::steady_clock::now();
+    for (int p = 0; p < passes; p++) legacyAccelerations(particles);
+    double legacy = chrono::duration<double>(chrono::steady_clock::now() - start).count()/passes;
+    start = chrono::steady_clock::now();
+    for (int p = 0; p < passes; p++) g.accelerations();
+    double vector = chrono::duration<double>(chrono::steady_clock::now() - start).count()/passes;
+    double maxError = 0;
+    for (int i = 0; i < g.N; i++) {
+        maxError = max(maxError, fabs(g.a[0][i] - particles[i].ax)/(fabs(particles[i].ax) + 1e-12));
+    }
+    cout << " N = " << g.N << ", all pairs:\n";
+    cout << "  original F:    " << pairs/legacy/1e6 << " M pairs/s (every pair evaluated twice)\n";
+    cout << "  vector kernel: " << pairs/vector/1e6 << " M pairs/s, " << legacy/vector
+         << " times faster (largest relative difference in ax: " << maxError << ")\n";
+
+    Grid big(316, 0.005, 0.3, 2.5, 0.3);
+    big.accelerations();
+    start = chrono::steady_clock::now();
+    for (int p = 0; p < passes; p++) big.accelerations();
+    double listed = chrono::duration<double>(chrono::steady_clock::now() - start).count()/passes;
+    cout << " N = " << big.N << ", neighbor list (cutoff 2.5, skin 0.3):\n";
+    cout << "  vector kernel: " << big.pairs()/listed/1e6 << " M pairs/s (" << big.pairs()
+         << " listed pairs, " << listed*1e3 << " ms per pass)\n";
+    return 0;
+}
+
+//seconds per step of steps steps of a N_c x N_c grid on nThreads threads, and the
+//potential energy at the end
+double stepTime(int N_c, int nThreads, bool deterministic, int steps, double &E_pot) {
+    Grid g(N_c, 0.005, 0.3, 2.5, 0.3, nThreads, deterministic);
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) g.updateParticles();
+    E_pot = g.E_pot();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count()/steps;
+}
+
+int threads(int steps, int maxThreads) {
+    cout << "\n" << steps << " steps, density 0.3, cutoff 2.5, " << thread::hardware_concurrency()
+         << " hardware threads\n";
+    vector<int> counts;
+    for (int n = 1; n <= maxThreads; n *= 2) counts.push_back(n);
+    if (counts.back() != maxThreads) counts.push_back(maxThreads);
+    char line[160];
+    double E_pot, base = 0;
+    cout << "strong scaling, N = 316 x 316:\n";
+    for (size_t k = 0; k < counts.size(); k++) {
+        double t = stepTime(316, counts[k], false, steps, E_pot);
+        if (k == 0) base = t;
+        snprintf(line, sizeof(line), " %3d threads: %8.3f ms/step, speedup %5.2f, efficiency %5.1f %%\n",
+                 counts[k], t*1e3, base/t, 100*base/t/counts[k]);
+        cout << line;
+    }
+    cout << "weak scaling, 25000 particles per thread:\n";
+    for (size_t k = 0; k < counts.size(); k++) {
+        int N_c = (int)round(sqrt(25000.0*counts[k]));
+        double t = stepTime(N_c, counts[k], false, steps, E_pot);
+        if (k == 0) base = t;
+        snprintf(line, sizeof(line), " %3d threads, N = %8d: %8.3f ms/step, efficiency %5.1f %%\n",
+                 counts[k], N_c*N_c, t*1e3, 100*base/t);
+        cout << line;
+    }
+    cout << "deterministic mode, N = 316 x 316:\n";
+    double first = 0;
+    for (size_t k = 0; k < counts.size(); k++) {
+        double t = stepTime(316, counts[k], true, steps, E_pot);
+        if (k == 0) first = E_pot;
+        snprintf(line, sizeof(line), " %3d threads: %8.3f ms/step, E_pot = %.17g (%s)\n", counts[k],
+                 t*1e3, E_pot, (E_pot == first) ? "same" : "DIFFERENT");
+        cout << line;
+    }
+    return 0;
+}
+
+//steps steps of N_c^D particles at density in a box with boundary B: the time per
+//step and per particle-step, and the relative change of the total energy
+template <int D, class B>
+void timeBox(string name, int N_c, double density, int steps) {
+    Atoms<D, B> g(N_c, 0.005, density, 2.5, 0.3);
+    double E_0 = g.E_tot();
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) g.updateParticles();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    char line[200];
+    snprintf(line, sizeof(line), " %s N = %7d: %8.3f ms/step, %6.1f ns per particle-step, "
+             "%9lld pairs, energy drift %.2e\n", name.c_str(), g.N, seconds/steps*1e3,
+             seconds/steps/g.N*1e9, g.pairs(), fabs(g.E_tot() - E_0)/fabs(E_0));
+    cout << line;
+}
+
+int dims(int steps) {
+    cout << "\n" << steps << " steps, cutoff 2.5, skin 0.3\n";
+    timeBox<2, Reflecting>("2D reflecting, density 0.3,", 316, 0.3, steps);
+    timeBox<2, Periodic>  ("2D periodic,   density 0.3,", 316, 0.3, steps);
+    timeBox<3, Reflecting>("3D reflecting, density 0.8,", 46, 0.8, steps);
+    timeBox<3, Periodic>  ("3D periodic,   density 0.8,", 46, 0.8, steps);
+    return 0;
+}
+
+//steps steps of a periodic 316 x 316 box from Maxwell-Boltzmann velocities at T = 1.5,
+//with the given thermostat and barostat. returns the seconds per step
+double timeEnsemble(string name, Thermostat::Kind thermostat, Barostat::Kind barostat, int steps,
+                    double base) {
+    Atoms<2, Periodic> g(316, 0.005, 0.3, 2.5, 0.3);
+    g.setTemperature(1.5, 1);
+    g.thermostat.kind = thermostat;
+    g.thermostat.T0 = 1.5;
+    g.thermostat.tau = 0.5;
+    g.thermostat.seed(1);
+    g.barostat.kind = barostat;
+    g.barostat.P0 = 0.5;
+    g.barostat.tau = 2;
+    double H_0 = g.conserved();
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) g.updateParticles();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count()/steps;
+    char line[200];
+    snprintf(line, sizeof(line), " %s %8.3f ms/step (%+5.1f %%), T = %.3f, P = %.3f, conserved "
+             "quantity changed by %.2e\n", name.c_str(), seconds*1e3,
+             (base > 0) ? 100*(seconds/base - 1) : 0.0, g.temperature(), g.pressure(),
+             fabs(g.conserved() - H_0)/fabs(H_0));
+    cout << line;
+    return seconds;
+}
+
+int ensembles(int steps) {
+    cout << "\n" << steps << " steps, density 0.3, cutoff 2.5, T = 1.5 (tau 0.5), P = 0.5 (tau 2)\n";
+    double base = timeEnsemble("NVE,                  ", Thermostat::none, Barostat::none, steps, 0);
+    timeEnsemble("Berendsen thermostat, ", Thermostat::berendsen, Barostat::none, steps, base);
+    timeEnsemble("Langevin (BAOAB),     ", Thermostat::langevin, Barostat::none, steps, base);
+    timeEnsemble("Nose-Hoover chain,    ", Thermostat::noseHoover, Barostat::none, steps, base);
+    timeEnsemble("Berendsen barostat,   ", Thermostat::berendsen, Barostat::berendsen, steps, base);
+    timeEnsemble("MTTK + Nose-Hoover,   ", Thermostat::noseHoover, Barostat::mttk, steps, base);
+    return 0;
+}
+
+//steps steps of a periodic 316 x 316 box, saving a frame every 10 steps to filename
+//(none if empty), in the background or not, and the energies of every step, flushed
+//line by line or not. prints the time per step, and the size of the files
+void timeOutput(string name, string filename, bool fixedPoint, bool background, bool flushLines,
+                int steps, double base) {
+    Atoms<2, Periodic> g(316, 0.005, 0.3, 2.5, 0.3);
+    AsyncWriter writer;
+    unique_ptr<Trajectory> trajectory;
+    if (background && !filename.empty()) trajectory.reset(new Trajectory(writer, filename, fixedPoint));
+    ofstream frames;
+    if (!background && !filename.empty()) frames.open(filename, ios::out | ios::trunc | ios::binary);
+    unique_ptr<EnergyLog> log;
+    ofstream energies;
+    if (flushLines) energies.open("bench_energies.csv", ios::out | ios::trunc);
+    else log.reset(new EnergyLog(writer, "bench_energies.csv"));
+    auto start = chrono::steady_clock::now();
+    for (int s = 1; s <= steps; s++) {
+        g.updateParticles();
+        if (flushLines) {
+            energies << g.E_tot() << " " << g.E_cin() << " " << g.E_pot() << " " << g.pressure() << endl;
+        }
+        else log->add({g.E_tot(), g.E_cin(), g.E_pot(), g.pressure()});
+        if (filename.empty() || s % 10 != 0) continue;
+        if (trajectory) trajectory->add(g, s*g.h);
+        else {
+            string data = encodeFrame(filename, *takeFrame(g, s*g.h), fixedPoint);
+            frames.write(data.data(), data.size());
+        }
+    }
+    double stepping = chrono::duration<double>(chrono::steady_clock::now() - start).count()/steps;
+    if (log) log->flush();
+    writer.wait();
+    frames.close();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count()/steps;
+    double MB = 0;
+    if (!filename.empty()) {
+        ifstream file(filename, ios::in | ios::binary | ios::ate);
+        MB = file.tellg()/1048576.0;
+    }
+    char line[200];
+    snprintf(line, sizeof(line), " %s %8.3f ms/step (%+5.1f %%), %8.3f ms/step until written, "
+             "%7.2f MB of frames\n", name.c_str(), stepping*1e3,
+             (base > 0) ? 100*(stepping/base - 1) : 0.0, seconds*1e3, MB);
+    cout << line;
+}
+
+int output(int steps) {
+    cout << "\n" << steps << " steps of N = 316 x 316, a frame every 10 steps, the energies every step\n";
+    char line[100];
+    double base = 0;
+    {
+        //the reference for the overheads
+        Atoms<2, Periodic> g(316, 0.005, 0.3, 2.5, 0.3);
+        auto start = chrono::steady_clock::now();
+        for (int s = 0; s < steps; s++) g.updateParticles();
+        base = chrono::duration<double>(chrono::steady_clock::now() - start).count()/steps;
+    }
+    snprintf(line, sizeof(line), " no output:                    %8.3f ms/step\n", base*1e3);
+    cout << line;
+    timeOutput("no frames, energy log:       ", "", false, true, false, steps, base);
+    timeOutput("no frames, endl per line:    ", "", false, true, true, steps, base);
+    timeOutput(".trj float32, same thread:   ", "bench_out.trj", false, false, false, steps, base);
+    timeOutput(".trj float32, background:    ", "bench_out.trj", false, true, false, steps, base);
+    timeOutput(".trj fixed, background:      ", "bench_out_q.trj", true, true, false, steps, base);
+    timeOutput(".xyz, same thread:           ", "bench_out.xyz", false, false, false, steps, base);
+    timeOutput(".xyz, background:            ", "bench_out.xyz", false, true, false, steps, base);
+    return 0;
+}
+
+//a time "time" of a periodic 316 x 316 box at density from Maxwell-Boltzmann velocities
+//at T, with cutoff rc, timestep h, respa inner steps of the forces closer than the switch
+//from r1 to r2 (0: velocity Verlet) and, if hMax > 0, the adaptive timestep. prints the time per unit of simulated time, and the largest
+//relative change of the total energy. returns the former
+double timeIntegrator(string name, double density, double T, double rc, double h, int respa,
+                      double r1, double r2, double hMax, double maxMove, double time, double base) {
+    Atoms<2, Periodic> g(316, h, density, rc, 0.3);
+    g.setTemperature(T, 1);
+    g.setRespa(respa, r1, r2);
+    g.setAdaptive(hMax, maxMove);
+    double E_0 = g.E_tot();
+    double drift = 0;
+    auto start = chrono::steady_clock::now();
+    while (g.time < time) {
+        g.updateParticles();
+        drift = max(drift, fabs(g.E_tot() - E_0)/fabs(E_0));
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count()/g.time;
+    char line[200];
+    snprintf(line, sizeof(line), " %s %5lld steps, %8.1f ms per unit of time (x%4.2f), "
+             "energy drift %.2e\n", name.c_str(), g.steps, seconds*1e3,
+             (base > 0) ? base/seconds : 1.0, drift);
+    cout << line;
+    return seconds;
+}
+
+//the integrators at density and T with cutoff rc, RESPA splitting the forces from r1 to r2
+void timeIntegrators(double density, double T, double rc, double r1, double r2, double time) {
+    cout << "\ntime " << time << ", density " << density << ", T = " << T << ", cutoff " << rc
+         << ", RESPA switch " << r1 << " to " << r2 << ", speedup against h = 0.005\n";
+    double base = timeIntegrator("velocity Verlet, h = 0.005,   ", density, T, rc, 0.005, 0, r1, r2, 0, 0, time, 0);
+    timeIntegrator("velocity Verlet, h = 0.01,    ", density, T, rc, 0.01, 0, r1, r2, 0, 0, time, base);
+    timeIntegrator("velocity Verlet, h = 0.015,   ", density, T, rc, 0.015, 0, r1, r2, 0, 0, time, base);
+    timeIntegrator("RESPA 2 x 0.005 (h = 0.01),   ", density, T, rc, 0.01, 2, r1, r2, 0, 0, time, base);
+    timeIntegrator("RESPA 3 x 0.005 (h = 0.015),  ", density, T, rc, 0.015, 3, r1, r2, 0, 0, time, base);
+    timeIntegrator("RESPA 4 x 0.005 (h = 0.02),   ", density, T, rc, 0.02, 4, r1, r2, 0, 0, time, base);
+    timeIntegrator("adaptive, move 0.02, h < 0.02,", density, T, rc, 0.005, 0, r1, r2, 0.02, 0.02, time, base);
+    timeIntegrator("adaptive, move 0.04, h < 0.02,", density, T, rc, 0.005, 0, r1, r2, 0.02, 0.04, time, base);
+}
+
+//a gas, where the neighbor searches (set by how far the particles go) take about half
+//the time, and a liquid with a longer cutoff, where the forces of the far pairs do
+int timestep(double time) {
+    timeIntegrators(0.3, 1.5, 2.5, 1.5, 1.8, time);
+    timeIntegrators(0.7, 1, 4, 2, 2.5, time);
+    return 0;
+}
+
+int replicas(int count, int steps) {
+    cout << "\n" << count << " replicas of a 30 x 30 grid (density 0.3, cutoff 2.5), " << steps
+         << " steps each\n";
+    char line[200];
+    //the usual way: a run per replica
+    auto start = chrono::steady_clock::now();
+    for (int k = 0; k < count; k++) {
+        Grid g(30, 0.005, 0.3, 2.5, 0.3, 1, false, k + 1, false);
+        for (int s = 0; s < steps; s++) g.updateParticles();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double base = (double)count*steps/seconds;
+    snprintf(line, sizeof(line), " separate runs:           %10.0f replica-steps/s\n", base);
+    cout << line;
+    int cores = max(1, (int)thread::hardware_concurrency());
+    for (int threads : {1, cores}) {
+        Replicas<2, Reflecting> runner(30, 0.005, 2.5, 0.3, threads);
+        for (int k = 0; k < count; k++) runner.add(0.3, k + 1);
+        runner.run(steps, 0, 1, Replicas<2, Reflecting>::Setup());
+        snprintf(line, sizeof(line), " runner on %3d threads:   %10.0f replica-steps/s (x%.2f)\n",
+                 threads, runner.throughput(), runner.throughput()/base);
+        cout << line;
+        if (cores == 1) break;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "scaling") return scaling((argc > 2) ? atoi(argv[2]) : 100);
+    if (argc > 1 && string(argv[1]) == "kernel") return kernel((argc > 2) ? atoi(argv[2]) : 20);
+    if (argc > 1 && string(argv[1]) == "threads") {
+        int cores = max(1, (int)thread::hardware_concurrency());
+        return threads((argc > 2) ? atoi(argv[2]) : 50, (argc > 3) ? atoi(argv[3]) : cores);
+    }
+    if (argc > 1 && string(argv[1]) == "dims") return dims((argc > 2) ? atoi(argv[2]) : 200);
+    if (argc > 1 && string(argv[1]) == "ensembles") return ensembles((argc > 2) ? atoi(argv[2]) : 200);
+    if (argc > 1 && string(argv[1]) == "output") return output((argc > 2) ? atoi(argv[2]) : 100);
+    if (argc > 1 && string(argv[1]) == "timestep") return timestep((argc > 2) ? atof(argv[2]) : 2);
+    if (argc > 1 && string(argv[1]) == "replicas") {
+        return replicas((argc > 2) ? atoi(argv[2]) : 32, (argc > 3) ? atoi(argv[3]) : 500);
+    }
+    cout << "usage: ./bench scaling [steps], ./bench kernel [passes], ./bench threads [steps] [max],"
+         << " ./bench dims [steps], ./bench ensembles [steps], ./bench output [steps],"
+         << " ./bench timestep [time] or ./bench replicas [replicas] [steps]\n";
+    return -1;
+}
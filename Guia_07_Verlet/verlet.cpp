@@ -1,177 +1,346 @@
-//simulates atoms in a 2D box that interact via Lennard-Jones potential, using Verlet integration algorithm
-//compilation: g++ -O3 -std=c++11 -o verlet verlet.cpp
+//simulates atoms in a 2D (or 3D) box that interact via Lennard-Jones potential, using Verlet integration algorithm
+//compilation: g++ -O3 -std=c++11 -march=native -pthread -o verlet verlet.cpp
+//make sure to keep Verlet.h, LJKernel.h, Thermostats.h, Output.h, Analysis.h and Replicas.h in
+//the same folder as verlet.cpp, and ../Common/Profiler.h, ThreadPool.h, Random.h and AsyncWriter.h
 
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <cstdlib>
+#include <memory>
 #include <vector>
-#include <cmath>
+#include <thread>
+
+#include "Verlet.h"
+#include "Output.h"
+#include "Analysis.h"
+#include "Replicas.h"
 
 using namespace std;
 
-class Particle {
-    public:
-        double x;
-        double y;
-        double vx;
-        double vy;
-        double ax = 0.0;
-        double ay = 0.0;
-        double prev_ax = 0.0;
-        double prev_ay = 0.0;
-        Particle(double x_, double y_, double vx_, double vy_) {
-            x = x_; y = y_; vx = vx_; vy = vy_;
-        }
-        //updates particle position, with timestep h
-        void update(double h) {
-            x += vx*h + 0.5*ax*pow(h, 2);
-            y += vy*h + 0.5*ay*pow(h, 2);
-        }
-        //returns magnitude of velocity squared
-        double velSquared() {
-            return (pow(vx, 2) + pow(vy, 2));
-        }
-        ~Particle() {}
+//temperature and pressure control: the initial temperature (0: the velocities of
+//"guia 6"), the thermostat and barostat and their targets and times
+struct Ensemble {
+    double T = 0;
+    uint64_t seed = 1;
+    Thermostat thermostat;
+    Barostat barostat;
 };
 
-class Grid {
-    public:
-        double density;
-        int N;    //number of particles
-        double L; //side length
-        double h;
-        vector<Particle> particles;
-        //constructor with specifications as requested in "guia 6"
-        Grid(int N_c, double h_, double density_) {
-            density = density_;
-            N = N_c*N_c;
-            h = h_;
-            L = sqrt(N/density);
-            double a = (double)L/(N_c + 1);
-            double v_0[2] {-1.1, 1.1};
-            for (int n = 1; n <= N_c; n++) {
-                for (int m = 1; m <= N_c; m++) {
-                    particles.push_back( Particle(n*a, m*a, v_0[rand() % 2], 0.0) );
-                }
-            }
-            //initial accelerations
-            for (int i = 0; i < N; i++) {
-                double ax = 0;
-                double ay = 0;
-                for (int j = 0; j < N; j++) {
-                    if (i != j) F(particles[i], particles[j], ax, ay);
-                }
-                particles[i].ax = ax;
-                particles[i].ay = ay;
-            }
-            cout << "\nGrid has been initialized. Info:\n";
-            cout << " - Number of particles N = " << N_c << "x" << N_c << " = " << N << endl;
-            cout << " - Density           rho = " << density << endl;
-            cout << " - Side of box length  L = " << L << endl;
-            cout << " - Timestep            h = " << h << endl;
-            cout << "\nStarting simulation...\n\n";
-        }
+//the timestep h, and how it is used: multiple time stepping with "respa" inner steps
+//of the forces closer than the switch from r1 to r2 (0: velocity Verlet), and if hMax
+//> 0, a timestep adapted every step so that no particle moves more than about maxMove
+//(see Grid::setRespa and Grid::setAdaptive)
+struct Timestep {
+    double h = 0.005;
+    int respa = 0;
+    double r1 = 1.5;
+    double r2 = 1.8;
+    double hMax = 0;
+    double maxMove = 0.01;
+};
 
-        void updateParticles() {
-            //update particles positions
-            for (int i = 0; i < N; i++) {
-                //update particle[i]'s position, with timestep h
-                particles[i].update(h);
-                //check if out of bounds
-                if ( particles[i].x < 0 ) {
-                    particles[i].vx *= -1;
-                    particles[i].x = -particles[i].x;
-                }
-                if ( particles[i].x > L ) {
-                    particles[i].vx *= -1;
-                    particles[i].x = 2*L - particles[i].x;
-                }
-                if ( particles[i].y < 0 ) {
-                    particles[i].vy *= -1;
-                    particles[i].y = -particles[i].y;
-                }
-                if ( particles[i].y > L ) {
-                    particles[i].vy *= -1;
-                    particles[i].y = 2*L - particles[i].y;
-                }
-            }
-            //update accelerations and velocities
-            for (int i = 0; i < N; i++) {
-                //set prev_ax, prev_ay of particle to newer, updated values
-                particles[i].prev_ax = particles[i].ax;
-                particles[i].prev_ay = particles[i].ay;
-                //temporary values to store the cumulative acceleration inflicted
-                //on particle i by all other particles j != i
-                double ax = 0;
-                double ay = 0;
-                for (int j = 0; j < N; j++) {
-                    //as we pass ax and ay to F(), the latter adds the acceleration inflicted
-                    //on particle i by particle j to ax and ay
-                    if (i != j) F(particles[i], particles[j], ax, ay);
-                }
-                //we now set the particles acceleration components
-                particles[i].ax = ax;
-                particles[i].ay = ay;
-                //finally, we update velocities
-                particles[i].vx += 0.5*(particles[i].ax + particles[i].prev_ax)*h;
-                particles[i].vy += 0.5*(particles[i].ay + particles[i].prev_ay)*h;
-            }
-        }
+//trajectory output: a frame every "every" iterations (0: none) to filename, in fixed
+//point if fixedPoint (see Output.h). and the analysis of Analysis.h, sampled every
+//"analysisEvery" iterations (0: none) and saved to files starting with analysisPrefix
+struct Frames {
+    string filename;
+    int every = 0;
+    bool fixedPoint = false;
+    string analysisPrefix;
+    int analysisEvery = 0;
+};
 
-        //returns cinetic energy
-        double E_cin() {
-            double E_k = 0.0;
-            for (int i = 0; i < N; i++) E_k += particles[i].velSquared();
-            return 0.5*E_k;
-        }
+//runs the simulation in a box of D dimensions with the given boundaries, saving the
+//energies to filename every "every" iterations
+template <int D, class Boundary>
+void simulate(string filename, Profiler &profiler, int N_c, double density, double rc, double skin,
+              int every, int threads, bool deterministic, const Ensemble &ensemble, const Timestep &timestep,
+              const Frames &frames) {
+    double h = timestep.h;
+
+    //create a Grid object where simulation will take place
+    Atoms<D, Boundary> g(N_c, h, density, rc, skin, threads, deterministic);
+    g.setProfiler(&profiler);
+    prepare(g, ensemble, timestep, ensemble.seed);
+    int energyPhase = profiler.phase("energy");
+    int io = profiler.phase("io");
+    int analysisPhase = profiler.phase("analysis");
+    int iterations = 2000;
+
+    unique_ptr<Analysis<D, Boundary>> analysis;
+    if (frames.analysisEvery > 0) {
+        analysis.reset(new Analysis<D, Boundary>(g, frames.analysisEvery*h, iterations/frames.analysisEvery));
+    }
 
-        //return potential energy
-        double E_pot() {
-            double E_p = 0.0;
-            for (int i = 0; i < N; i++) {
-                for (int j = i+1; j < N; j++) {
-                    E_p += U(particles[i], particles[j]);
-                }
+    //the energies and the frames are written by a background thread
+    AsyncWriter writer;
+    EnergyLog log(writer, filename);
+    unique_ptr<Trajectory> trajectory;
+    if (frames.every > 0) {
+        trajectory.reset(new Trajectory(writer, frames.filename, frames.fixedPoint));
+        trajectory->add(g, 0);
+    }
+    
+    //save initial energy values. fomart (delimiter=" "):
+    //E_TOTAL E_CINETIC E_POTENTIAL PRESSURE TEMPERATURE VOLUME CONSERVED
+    log.add({g.E_tot(), g.E_cin(), g.E_pot(), g.pressure(), g.temperature(), g.volume(), g.conserved()});
+    for (int i = 1; i <= iterations; i++) {
+        bool sample = analysis && i % frames.analysisEvery == 0;
+        //g(r) is counted by the force evaluation of the step
+        if (sample) analysis->beforeStep(g);
+        g.updateParticles();
+        if (sample) {
+            Profiler::Timer timer(&profiler, analysisPhase);
+            analysis->afterStep(g, g.time);
+        }
+        if (i % every == 0) {
+            //the energies and the virial were all summed by the passes of the step
+            double E_cin, E_pot, P, T, V, H;
+            {
+                Profiler::Timer timer(&profiler, energyPhase);
+                E_cin = g.E_cin();
+                E_pot = g.E_pot();
+                P = g.pressure();
+                T = g.temperature();
+                V = g.volume();
+                H = g.conserved();
             }
-            return E_p;
+            //save energies to file
+            Profiler::Timer timer(&profiler, io);
+            log.add({E_cin + E_pot, E_cin, E_pot, P, T, V, H});
         }
-
-        //returns total energy
-        double E_tot() {
-            return E_cin()+E_pot();
+        if (trajectory && i % frames.every == 0) {
+            Profiler::Timer timer(&profiler, io);
+            trajectory->add(g, g.time);
         }
+        //print progress of simulation, a few times per second
+        if (profiler.due()) profiler.progress(i, (double)i/iterations, "Iteration: " + to_string(i));
+    }
+    {
+        //what is still being written
+        Profiler::Timer timer(&profiler, io);
+        log.flush();
+        writer.wait();
+    }
+    if (trajectory) cout << "\n" << trajectory->frames << " frames saved to " << frames.filename << "\n";
+    if (analysis) {
+        Profiler::Timer timer(&profiler, analysisPhase);
+        if (analysis->save(frames.analysisPrefix)) {
+            cout << "\ng(r), S(k), MSD and VACF saved to " << frames.analysisPrefix << "_*.csv\n";
+        }
+        else cout << "\nCouldn't save the analysis to " << frames.analysisPrefix << "_*.csv\n";
+    }
+    profiler.steps = iterations;
+}
 
-        ~Grid() {}
+//the temperature, thermostat, barostat and timestep of a box, with the given seed
+template <int D, class Boundary>
+void prepare(Atoms<D, Boundary> &g, const Ensemble &ensemble, const Timestep &timestep, uint64_t seed) {
+    if (ensemble.T > 0) g.setTemperature(ensemble.T, seed);
+    g.thermostat = ensemble.thermostat;
+    g.thermostat.seed(seed);
+    g.barostat = ensemble.barostat;
+    g.setRespa(timestep.respa, timestep.r1, timestep.r2);
+    g.setAdaptive(timestep.hMax, timestep.maxMove);
+}
 
-    private:
-        //calculate potential between two particles
-        double U(Particle a, Particle b) {
-            double r = pow(a.x - b.x, 2) + pow(a.y - b.y, 2);
-            double u = 4 * (pow(r, -6) - pow(r, -3));
-            return u;
-        }
-        //calculate acceleration inflicted on particle a by particle b
-        //arguments are the two particles, and references to two doubles
-        //that represent acceleration_x and acceleration_y
-        //the function adds the components calculated to ax and ay
-        void F(Particle a, Particle b, double &ax, double &ay) {
-            double r = pow(a.x - b.x, 2) + pow(a.y - b.y, 2);
-            double f = 24 * (2 * pow(r, -7) - pow(r, -4));
-            ax += (a.x - b.x) * f;
-            ay += (a.y - b.y) * f;
-        }
-};
+//runs "replicas" replicas at every density, with seeds seed, seed + 1..., on threads
+//threads, for the iterations of a simulation. their averages, sampled every "every"
+//iterations after the first equilibration ones, are saved to filename, and their means
+//printed (see Replicas.h)
+template <int D, class Boundary>
+void simulateReplicas(string filename, Profiler &profiler, int N_c, const vector<double> &densities,
+                      int replicas, int equilibration, double rc, double skin, int every, int threads,
+                      const Ensemble &ensemble, const Timestep &timestep) {
+    int iterations = 2000;
+    Replicas<D, Boundary> runner(N_c, timestep.h, rc, skin, threads);
+    for (double density : densities) {
+        for (int k = 0; k < replicas; k++) runner.add(density, ensemble.seed + k);
+    }
+    cout << "\nRunning " << densities.size()*replicas << " replicas of " << N_c << "^" << D
+         << " particles on " << threads << " threads...\n";
+    int replicaPhase = profiler.phase("replicas");
+    {
+        Profiler::Timer timer(&profiler, replicaPhase, (long long)densities.size()*replicas*iterations);
+        runner.run(iterations, equilibration, every, [&](Atoms<D, Boundary> &g, uint64_t seed) {
+            prepare(g, ensemble, timestep, seed);
+        }, &profiler);
+    }
+    runner.summary(cout);
+    if (!runner.save(filename)) cout << "Couldn't save the replicas to " << filename << "\n";
+    profiler.steps = runner.replicaSteps;
+}
 
 int main(int argc, char* argv[]) {
     
     //some example code that will simulate 900 particles, placed with density 0.3, and timestep h = 0.005
-    //the 3 energies will be saved on each iteration to file "energies_out.csv"
+    //the 3 energies, and the pressure, will be saved on each iteration to file "energies_out.csv"
     //a total of 2000 iterations are saved
 
+    //"-profile <file>" writes the time spent in each phase of the run to file, as JSON
+    //(see Common/Profiler.h). a summary is printed at the end
+    Profiler profiler("verlet");
+    for (int i = 1; i+1 < argc; i++) {
+        if (string(argv[i]) == "-profile") profiler.dumpFilename = argv[i+1];
+    }
+
+    //"-cutoff <rc>" truncates the potential at rc (default 2.5), and "-skin <s>" sets the
+    //extra distance of the neighbor list (default 0.3). "-cutoff 0" interacts all pairs
+    //"-every <k>" saves the energies every k iterations only (default 1)
+    double rc = 2.5;
+    double skin = 0.3;
+    int every = 1;
+    for (int i = 1; i+1 < argc; i++) {
+        if (string(argv[i]) == "-cutoff") rc = atof(argv[i+1]);
+        if (string(argv[i]) == "-skin") skin = atof(argv[i+1]);
+        if (string(argv[i]) == "-every") every = max(1, atoi(argv[i+1]));
+    }
+
+    //"-threads <n>" runs the steps on n threads (see Grid::setThreads), and
+    //"-deterministic" makes the results independent of n
+    int threads = 1;
+    bool deterministic = false;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "-threads" && i+1 < argc) threads = atoi(argv[i+1]);
+        if (string(argv[i]) == "-deterministic") deterministic = true;
+    }
+
+    //"-dim 3" simulates 30x30x30 particles in a 3D box instead, and "-periodic" uses
+    //periodic boundaries instead of reflecting walls. "-density <rho>" (default 0.3)
+    int dim = 2;
+    bool periodic = false;
+    double density = 0.3;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "-dim" && i+1 < argc) dim = atoi(argv[i+1]);
+        if (string(argv[i]) == "-density" && i+1 < argc) density = atof(argv[i+1]);
+        if (string(argv[i]) == "-periodic") periodic = true;
+    }
+    if (dim != 2 && dim != 3) {
+        cout << "Only 2 or 3 dimensions are supported. Exiting...\n";
+        return -1;
+    }
+
+    //"-temperature <T>" starts from Maxwell-Boltzmann velocities at T instead, drawn with
+    //"-seed <n>" (default 1), which also seeds the Langevin noise
+    //"-thermostat <berendsen|langevin|nosehoover> <T> <tau>" holds the temperature at T,
+    //with coupling time tau, and "-chain <M>" sets the length of the Nose-Hoover chain
+    //"-barostat <berendsen|mttk> <P> <tau>" holds the pressure at P, and
+    //"-compressibility <beta>" is that of the Berendsen barostat (default 1)
+    Ensemble ensemble;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-temperature" && i+1 < argc) ensemble.T = atof(argv[i+1]);
+        if (arg == "-seed" && i+1 < argc) ensemble.seed = strtoull(argv[i+1], NULL, 10);
+        if (arg == "-chain" && i+1 < argc) ensemble.thermostat.chain = max(1, atoi(argv[i+1]));
+        if (arg == "-compressibility" && i+1 < argc) ensemble.barostat.compressibility = atof(argv[i+1]);
+        if (arg == "-thermostat" && i+3 < argc) {
+            string kind = argv[i+1];
+            if (kind == "berendsen") ensemble.thermostat.kind = Thermostat::berendsen;
+            else if (kind == "langevin") ensemble.thermostat.kind = Thermostat::langevin;
+            else if (kind == "nosehoover") ensemble.thermostat.kind = Thermostat::noseHoover;
+            else {
+                cout << "Unknown thermostat: " << kind << ". Exiting...\n";
+                return -1;
+            }
+            ensemble.thermostat.T0 = atof(argv[i+2]);
+            ensemble.thermostat.tau = atof(argv[i+3]);
+        }
+        if (arg == "-barostat" && i+3 < argc) {
+            string kind = argv[i+1];
+            if (kind == "berendsen") ensemble.barostat.kind = Barostat::berendsen;
+            else if (kind == "mttk") ensemble.barostat.kind = Barostat::mttk;
+            else {
+                cout << "Unknown barostat: " << kind << ". Exiting...\n";
+                return -1;
+            }
+            ensemble.barostat.P0 = atof(argv[i+2]);
+            ensemble.barostat.tau = atof(argv[i+3]);
+        }
+    }
+
+    //"-respa <n> <r1> <r2>" does n inner steps of the forces closer than the switch from
+    //r1 to r2 per step (multiple time stepping), and "-timestep <h>" sets h (default
+    //0.005). "-adaptive <hMax> <maxMove>" adapts h every step, up to hMax, so that no
+    //particle moves more than about maxMove in a step
+    Timestep timestep;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-timestep" && i+1 < argc) timestep.h = atof(argv[i+1]);
+        if (arg == "-respa" && i+3 < argc) {
+            timestep.respa = max(0, atoi(argv[i+1]));
+            timestep.r1 = atof(argv[i+2]);
+            timestep.r2 = atof(argv[i+3]);
+        }
+        if (arg == "-adaptive" && i+2 < argc) {
+            timestep.hMax = atof(argv[i+1]);
+            timestep.maxMove = atof(argv[i+2]);
+        }
+    }
+
+    //"-trajectory <file> <k>" saves a frame every k iterations to file: binary (.trj) or
+    //XYZ text (.xyz), and "-fixedpoint" makes the binary frames half as big
+    Frames frames;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "-trajectory" && i+2 < argc) {
+            frames.filename = argv[i+1];
+            frames.every = max(0, atoi(argv[i+2]));
+        }
+        if (string(argv[i]) == "-fixedpoint") frames.fixedPoint = true;
+    }
+    //"-analysis <prefix> <k>" samples g(r), S(k), the MSD and the VACF every k iterations,
+    //saved to <prefix>_rdf.csv, _sk.csv, _msd.csv and _vacf.csv (see Analysis.h)
+    for (int i = 1; i+2 < argc; i++) {
+        if (string(argv[i]) == "-analysis") {
+            frames.analysisPrefix = argv[i+1];
+            frames.analysisEvery = max(0, atoi(argv[i+2]));
+        }
+    }
+
+    //"-replicas <n>" runs n independent replicas of the box instead, seeded seed, seed + 1...,
+    //at the density or at each of "-densities <rho1,rho2,...>", on the -threads given
+    //(default: all the cores), and saves their averages to replicas_out.csv. the first
+    //"-equilibrate <k>" iterations (default 500) aren't sampled
+    int replicas = 0;
+    int equilibration = 500;
+    bool threadsGiven = false;
+    vector<double> densities;
+    for (int i = 1; i+1 < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-replicas") replicas = max(0, atoi(argv[i+1]));
+        if (arg == "-equilibrate") equilibration = max(0, atoi(argv[i+1]));
+        if (arg == "-threads") threadsGiven = true;
+        if (arg == "-densities") {
+            string list = argv[i+1];
+            for (size_t start = 0; start < list.size(); ) {
+                size_t end = min(list.find(',', start), list.size());
+                densities.push_back(atof(list.substr(start, end - start).c_str()));
+                start = end + 1;
+            }
+        }
+    }
+    if (densities.empty()) densities.push_back(density);
+    if (replicas > 0) {
+        char const* filename = "replicas_out.csv";
+        int cores = max(1, (int)thread::hardware_concurrency());
+        int replicaThreads = threadsGiven ? max(1, threads) : cores;
+        int N_c = 30;
+        if (dim == 2 && !periodic) simulateReplicas<2, Reflecting>(filename, profiler, N_c, densities, replicas, equilibration, rc, skin, every, replicaThreads, ensemble, timestep);
+        if (dim == 2 && periodic) simulateReplicas<2, Periodic>(filename, profiler, N_c, densities, replicas, equilibration, rc, skin, every, replicaThreads, ensemble, timestep);
+        if (dim == 3 && !periodic) simulateReplicas<3, Reflecting>(filename, profiler, N_c, densities, replicas, equilibration, rc, skin, every, replicaThreads, ensemble, timestep);
+        if (dim == 3 && periodic) simulateReplicas<3, Periodic>(filename, profiler, N_c, densities, replicas, equilibration, rc, skin, every, replicaThreads, ensemble, timestep);
+        cout << "\nAverages of every replica saved to " << filename << "\n";
+        profiler.summary();
+        cout << "\nDone...\n";
+        return 0;
+    }
+
     char const* filename = "energies_out.csv";
     fstream file;
     file.open(filename, ios::out | ios::trunc);
     if (file.is_open()) {
         cout << "Will save to file: " << filename << endl;
+        file.close();
     }
     else {
         cout << "Couldn't open file: " << filename << ". Exiting...\n";
@@ -179,22 +348,11 @@ int main(int argc, char* argv[]) {
     }
 
     int N_c = 30;
-    double h = 0.005;
-    double density = 0.3;
-
-    //create a Grid object where simulation will take place
-    Grid g = Grid(N_c, h, density);
-    
-    //save initial energy values. fomart (delimiter=" "): E_TOTAL E_CINETIC E_POTENTIAL
-    file << g.E_tot() << " " << g.E_cin() << " " << g.E_pot() << endl;
-    for (int i = 1; i <= 2000; i++) {
-        g.updateParticles();
-        //print progress of simulation
-        cout << "\rIteration: " << i << flush;
-        //save energies to file
-        file << g.E_tot() << " " << g.E_cin() << " " << g.E_pot() << endl;
-    }
+    if (dim == 2 && !periodic) simulate<2, Reflecting>(filename, profiler, N_c, density, rc, skin, every, threads, deterministic, ensemble, timestep, frames);
+    if (dim == 2 && periodic) simulate<2, Periodic>(filename, profiler, N_c, density, rc, skin, every, threads, deterministic, ensemble, timestep, frames);
+    if (dim == 3 && !periodic) simulate<3, Reflecting>(filename, profiler, N_c, density, rc, skin, every, threads, deterministic, ensemble, timestep, frames);
+    if (dim == 3 && periodic) simulate<3, Periodic>(filename, profiler, N_c, density, rc, skin, every, threads, deterministic, ensemble, timestep, frames);
+    profiler.summary();
     cout << "\nDone...\n";
-    file.close();
     return 0;
 }
\ No newline at end of file